@@ -0,0 +1,463 @@
+/*
+ * GLib coroutine channels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcochannel
+ * @title: Channels
+ * @short_description: bounded message queues between coroutines
+ * @see_also: #GCoQueue, #GAsyncQueue
+ *
+ * A #GCoChannel passes pointers from producer coroutines to consumer
+ * coroutines, in FIFO order, through a fixed-size ring buffer. Any
+ * number of coroutines can send or receive on the same channel.
+ *
+ * Sending to a full channel, or receiving from an empty one, yields
+ * %NULL to the caller of the current coroutine until the operation can
+ * make progress. g_co_channel_send_many() and
+ * g_co_channel_receive_many() transfer as many items as possible at
+ * each step, which saves coroutine switches when moving many items.
+ *
+ * A channel can be closed with g_co_channel_close(). Items already
+ * sent can still be received, but no new ones can be sent.
+ */
+
+struct _GCoChannel {
+  gint      ref_count;
+  gpointer *buffer;
+  guint     capacity;
+  guint     head;       /* index of the oldest item */
+  guint     length;
+  gboolean  closed;
+  GCoQueue  senders;    /* waiting for free space */
+  GCoQueue  receivers;  /* waiting for items */
+};
+
+/**
+ * GCoChannel:
+ *
+ * The #GCoChannel struct is an opaque data structure which represents
+ * a bounded channel between coroutines.
+ */
+
+/**
+ * g_co_channel_new:
+ * @capacity: the maximum number of items in the channel
+ *
+ * Creates a new channel which can hold up to @capacity items.
+ *
+ * Returns: a new #GCoChannel, free with g_co_channel_unref()
+ **/
+GCoChannel *
+g_co_channel_new (guint capacity)
+{
+  GCoChannel *channel;
+
+  g_return_val_if_fail (capacity > 0, NULL);
+
+  channel = g_slice_new0 (GCoChannel);
+  channel->ref_count = 1;
+  channel->buffer = g_new (gpointer, capacity);
+  channel->capacity = capacity;
+  g_co_queue_init (&channel->senders);
+  g_co_queue_init (&channel->receivers);
+
+  return channel;
+}
+
+/**
+ * g_co_channel_ref:
+ * @channel: a #GCoChannel
+ *
+ * Increase the reference count on @channel.
+ *
+ * Returns: a new reference to @channel
+ **/
+GCoChannel *
+g_co_channel_ref (GCoChannel *channel)
+{
+  g_return_val_if_fail (channel != NULL, NULL);
+
+  g_atomic_int_inc (&channel->ref_count);
+
+  return channel;
+}
+
+/**
+ * g_co_channel_unref:
+ * @channel: a #GCoChannel
+ *
+ * Decrease the reference count on @channel, possibly freeing it. Items
+ * still in the channel are not freed.
+ **/
+void
+g_co_channel_unref (GCoChannel *channel)
+{
+  g_return_if_fail (channel != NULL);
+
+  if (g_atomic_int_dec_and_test (&channel->ref_count))
+    {
+      g_warn_if_fail (g_co_queue_is_empty (&channel->senders));
+      g_warn_if_fail (g_co_queue_is_empty (&channel->receivers));
+      g_free (channel->buffer);
+      g_slice_free (GCoChannel, channel);
+    }
+}
+
+/* Copy up to @n items into the ring, returns the number copied */
+static guint
+channel_push (GCoChannel *channel,
+              gpointer   *data,
+              guint       n)
+{
+  guint tail, count, first;
+
+  count = MIN (n, channel->capacity - channel->length);
+  tail = (channel->head + channel->length) % channel->capacity;
+  first = MIN (count, channel->capacity - tail);
+
+  memcpy (channel->buffer + tail, data, first * sizeof (gpointer));
+  memcpy (channel->buffer, data + first, (count - first) * sizeof (gpointer));
+  channel->length += count;
+
+  return count;
+}
+
+/* Copy up to @n items out of the ring, returns the number copied */
+static guint
+channel_pop (GCoChannel *channel,
+             gpointer   *data,
+             guint       n)
+{
+  guint count, first;
+
+  count = MIN (n, channel->length);
+  first = MIN (count, channel->capacity - channel->head);
+
+  memcpy (data, channel->buffer + channel->head, first * sizeof (gpointer));
+  memcpy (data + first, channel->buffer, (count - first) * sizeof (gpointer));
+  channel->head = (channel->head + count) % channel->capacity;
+  channel->length -= count;
+
+  return count;
+}
+
+/* Wakes up to @n of the coroutines waiting on @queue, or all of them
+ * if @n is -1. Outside of a coroutine there is no caller to schedule
+ * them after, so they are resumed right away. */
+static void
+channel_wake (GCoQueue *queue,
+              gint      n)
+{
+  gint i;
+
+  if (g_in_coroutine ())
+    {
+      g_co_queue_schedule (queue, n);
+      return;
+    }
+
+  /* the resumed coroutines may wait again on @queue */
+  if (n == -1)
+    n = g_queue_get_length (&queue->queue);
+
+  for (i = 0; i < n && !g_co_queue_is_empty (queue); i++)
+    g_co_queue_resume_head (queue, NULL);
+}
+
+/**
+ * g_co_channel_send:
+ * @channel: a #GCoChannel
+ * @data: the item to send
+ *
+ * Sends @data to @channel. If @channel is full, the current coroutine
+ * will yield %NULL until there is room for it.
+ *
+ * Returns: %TRUE if @data was sent, %FALSE if @channel is closed
+ **/
+gboolean
+g_co_channel_send (GCoChannel *channel,
+                   gpointer    data) G_COROUTINE_FUNC
+{
+  return g_co_channel_send_many (channel, &data, 1) == 1;
+}
+
+/**
+ * g_co_channel_send_many:
+ * @channel: a #GCoChannel
+ * @data: (array length=n): the items to send
+ * @n: the number of items
+ *
+ * Sends the @n items of @data to @channel, in order. Whenever @channel
+ * is full, the current coroutine will yield %NULL until there is room
+ * for more items.
+ *
+ * Returns: the number of items sent, less than @n only if @channel
+ * got closed, or if the current coroutine was cancelled, see
+ * g_coroutine_cancel()
+ **/
+guint
+g_co_channel_send_many (GCoChannel *channel,
+                        gpointer   *data,
+                        guint       n) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  guint sent = 0;
+
+  g_return_val_if_fail (channel != NULL, 0);
+  g_return_val_if_fail (data != NULL || n == 0, 0);
+
+  while (sent < n)
+    {
+      guint count;
+
+      while (channel->length == channel->capacity && !channel->closed &&
+             !self->cancelled)
+        g_co_queue_yield (&channel->senders, NULL);
+
+      if (channel->closed || channel->length == channel->capacity)
+        break;
+
+      count = channel_push (channel, data + sent, n - sent);
+      sent += count;
+      g_co_queue_schedule (&channel->receivers, count);
+    }
+
+  return sent;
+}
+
+/**
+ * g_co_channel_try_send:
+ * @channel: a #GCoChannel
+ * @data: the item to send
+ *
+ * Sends @data to @channel if there is room for it, without ever
+ * yielding. It can be called outside of a coroutine, in which case a
+ * coroutine waiting for items is resumed before it returns.
+ *
+ * Returns: %TRUE if @data was sent
+ **/
+gboolean
+g_co_channel_try_send (GCoChannel *channel,
+                       gpointer    data)
+{
+  g_return_val_if_fail (channel != NULL, FALSE);
+
+  if (channel->closed || channel->length == channel->capacity)
+    return FALSE;
+
+  channel_push (channel, &data, 1);
+  channel_wake (&channel->receivers, 1);
+
+  return TRUE;
+}
+
+/**
+ * g_co_channel_receive:
+ * @channel: a #GCoChannel
+ * @data: (out): return location for the received item
+ *
+ * Receives the oldest item of @channel. If @channel is empty, the
+ * current coroutine will yield %NULL until an item is sent.
+ *
+ * Returns: %TRUE if an item was received, %FALSE if @channel is closed
+ * and empty
+ **/
+gboolean
+g_co_channel_receive (GCoChannel *channel,
+                      gpointer   *data) G_COROUTINE_FUNC
+{
+  return g_co_channel_receive_many (channel, data, 1) == 1;
+}
+
+/**
+ * g_co_channel_receive_many:
+ * @channel: a #GCoChannel
+ * @data: (out caller-allocates) (array length=n): return location for
+ *     the received items
+ * @n: the maximum number of items to receive
+ *
+ * Receives up to @n of the oldest items of @channel. If @channel is
+ * empty, the current coroutine will yield %NULL until at least one item
+ * is sent; it then receives all the available items, up to @n, without
+ * waiting for more.
+ *
+ * Returns: the number of items received, 0 only if @channel is closed
+ * and empty, or if the current coroutine was cancelled, see
+ * g_coroutine_cancel()
+ **/
+guint
+g_co_channel_receive_many (GCoChannel *channel,
+                           gpointer   *data,
+                           guint       n) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  guint count;
+
+  g_return_val_if_fail (channel != NULL, 0);
+  g_return_val_if_fail (data != NULL, 0);
+  g_return_val_if_fail (n > 0, 0);
+
+  while (channel->length == 0 && !channel->closed && !self->cancelled)
+    g_co_queue_yield (&channel->receivers, NULL);
+
+  count = channel_pop (channel, data, n);
+  g_co_queue_schedule (&channel->senders, count);
+
+  return count;
+}
+
+/**
+ * g_co_channel_receive_any:
+ * @channels: (array length=n_channels): an array of #GCoChannel
+ * @n_channels: the number of channels in @channels
+ * @data: (out): return location for the received item
+ *
+ * Receives the oldest item of the first of @channels that is not
+ * empty. If all of them are empty, the current coroutine will yield
+ * %NULL until an item is sent to any of them, using
+ * g_co_queue_select().
+ *
+ * Returns: the index in @channels of the channel the item was received
+ * from, or -1 if all of @channels are closed and empty, or if the
+ * current coroutine was cancelled
+ **/
+gint
+g_co_channel_receive_any (GCoChannel **channels,
+                          guint        n_channels,
+                          gpointer    *data) G_COROUTINE_FUNC
+{
+  GCoQueue **queues;
+  gint index = 0;
+  guint i;
+
+  g_return_val_if_fail (channels != NULL, -1);
+  g_return_val_if_fail (n_channels > 0, -1);
+  g_return_val_if_fail (data != NULL, -1);
+
+  queues = g_newa (GCoQueue *, n_channels);
+
+  while (TRUE)
+    {
+      gboolean closed = TRUE;
+
+      /* start from the channel that scheduled us, so that its item is
+       * not left behind while its other receivers keep waiting */
+      for (i = 0; i < n_channels; i++)
+        {
+          guint n = (index + i) % n_channels;
+
+          if (g_co_channel_try_receive (channels[n], data))
+            return n;
+
+          closed = closed && channels[n]->closed;
+          queues[i] = &channels[i]->receivers;
+        }
+
+      if (closed || g_coroutine_self ()->cancelled)
+        return -1;
+
+      index = g_co_queue_select (queues, n_channels, NULL);
+      index = MAX (index, 0);
+    }
+}
+
+/**
+ * g_co_channel_try_receive:
+ * @channel: a #GCoChannel
+ * @data: (out): return location for the received item
+ *
+ * Receives the oldest item of @channel if there is one, without ever
+ * yielding. It can be called outside of a coroutine, in which case a
+ * coroutine waiting for free space is resumed before it returns.
+ *
+ * Returns: %TRUE if an item was received
+ **/
+gboolean
+g_co_channel_try_receive (GCoChannel *channel,
+                          gpointer   *data)
+{
+  g_return_val_if_fail (channel != NULL, FALSE);
+  g_return_val_if_fail (data != NULL, FALSE);
+
+  if (channel->length == 0)
+    return FALSE;
+
+  channel_pop (channel, data, 1);
+  channel_wake (&channel->senders, 1);
+
+  return TRUE;
+}
+
+/**
+ * g_co_channel_close:
+ * @channel: a #GCoChannel
+ *
+ * Closes @channel. Sending to a closed channel fails, and receiving
+ * from it fails once it is empty. All the waiting coroutines are
+ * scheduled so that they can notice it, or resumed before it returns
+ * when called outside of a coroutine.
+ **/
+void
+g_co_channel_close (GCoChannel *channel)
+{
+  g_return_if_fail (channel != NULL);
+
+  channel->closed = TRUE;
+  channel_wake (&channel->senders, -1);
+  channel_wake (&channel->receivers, -1);
+}
+
+/**
+ * g_co_channel_is_closed:
+ * @channel: a #GCoChannel
+ *
+ * Returns %TRUE if @channel was closed with g_co_channel_close().
+ *
+ * Returns: %TRUE if @channel is closed
+ **/
+gboolean
+g_co_channel_is_closed (GCoChannel *channel)
+{
+  g_return_val_if_fail (channel != NULL, FALSE);
+
+  return channel->closed;
+}
+
+/**
+ * g_co_channel_get_length:
+ * @channel: a #GCoChannel
+ *
+ * Returns the number of items waiting in @channel.
+ *
+ * Returns: the number of items in @channel
+ **/
+guint
+g_co_channel_get_length (GCoChannel *channel)
+{
+  g_return_val_if_fail (channel != NULL, 0);
+
+  return channel->length;
+}
@@ -0,0 +1,70 @@
+/*
+ * GLib coroutine channels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __G_CO_CHANNEL_H__
+#define __G_CO_CHANNEL_H__
+
+#if !defined(GCOROUTINE_H_INSIDE) && !defined(GCOROUTINE_COMPILATION)
+#error "Only gcoroutine.h can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+typedef struct _GCoChannel GCoChannel;
+
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoChannel *           g_co_channel_new          (guint        capacity);
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoChannel *           g_co_channel_ref          (GCoChannel  *channel);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_channel_unref        (GCoChannel  *channel);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_channel_send         (GCoChannel  *channel,
+                                                  gpointer     data) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+guint                  g_co_channel_send_many    (GCoChannel  *channel,
+                                                  gpointer    *data,
+                                                  guint        n) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_channel_try_send     (GCoChannel  *channel,
+                                                  gpointer     data);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_channel_receive      (GCoChannel  *channel,
+                                                  gpointer    *data) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+guint                  g_co_channel_receive_many (GCoChannel  *channel,
+                                                  gpointer    *data,
+                                                  guint        n) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gint                   g_co_channel_receive_any  (GCoChannel **channels,
+                                                  guint        n_channels,
+                                                  gpointer    *data) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_channel_try_receive  (GCoChannel  *channel,
+                                                  gpointer    *data);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_channel_close        (GCoChannel  *channel);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_channel_is_closed    (GCoChannel  *channel);
+GCOROUTINE_AVAILABLE_IN_1_0
+guint                  g_co_channel_get_length   (GCoChannel  *channel);
+
+G_END_DECLS
+
+#endif /* __G_CO_CHANNEL_H__ */
@@ -0,0 +1,590 @@
+/*
+ * GLib coroutine worker pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcopool
+ * @title: Worker pool
+ * @short_description: running coroutines on several threads
+ * @see_also: #GThread
+ *
+ * A #GCoPool runs coroutines on a fixed number of worker threads.
+ * Coroutines are added with g_co_pool_add(), and a coroutine gives the
+ * others a chance to run with g_co_pool_yield(), which puts it back in
+ * the run-queue of its worker.
+ *
+ * Each worker owns a work-stealing deque of runnable coroutines: it
+ * pushes the coroutines it runs to it, and a worker with nothing to
+ * run takes the oldest coroutine from the deque of another worker.
+ * Only coroutines marked with g_coroutine_set_migratable() are put in
+ * the deques; the other ones stay in a private queue, and always run
+ * on the first worker that ran them.
+ *
+ * The coroutines of a pool may only share data with thread-safe
+ * primitives, such as a #GCoMutex initialized with
+ * %G_CO_MUTEX_THREAD_SAFE. A coroutine waiting on such a mutex stays
+ * in the pool, and is queued again once the mutex is handed over to
+ * it, on the worker that ran it unless it is migratable. A coroutine that yields any other way leaves the
+ * pool: whatever resumes it later does so in its own thread.
+ */
+
+#define CO_DEQUE_MIN_SIZE 64
+
+/* top and bottom only grow, and wrap around: compare them by their
+ * unsigned difference */
+#define CO_DEQUE_LEN(top, bottom) ((gint) ((guint) (bottom) - (guint) (top)))
+
+typedef struct {
+  gint          size;           /* a power of two */
+  GCoroutine   *buf[1];
+} CoDequeArray;
+
+/* A Chase-Lev deque, only pushed to by the worker owning it. The owner
+ * takes from the top like the thieves, to run its coroutines in FIFO
+ * order. */
+typedef struct {
+  gint          top;
+  gint          bottom;
+  CoDequeArray *array;
+  GSList       *retired;        /* arrays thieves may still read */
+} CoDeque;
+
+struct _GCoWorker {
+  GCoPool      *pool;
+  GThread      *thread;
+  CoDeque       deque;          /* migratable coroutines */
+  GQueue        local;          /* pinned to the worker */
+  GQueue        inbox;          /* pinned and woken up, with the pool lock */
+  gint          n_inbox;
+  gboolean      yielded;
+  guint         ticks;
+  guint32       seed;           /* to pick victims */
+};
+
+struct _GCoPool {
+  guint         n_workers;
+  GCoWorker    *workers;
+  GMutex        lock;
+  GCond         cond;
+  GQueue        injected;       /* added from outside the pool */
+  gint          n_injected;
+  gint          n_idle;
+  gint          n_coroutines;
+  gboolean      closing;
+};
+
+static CoDequeArray *
+co_deque_array_new (gint size)
+{
+  CoDequeArray *a;
+
+  a = g_malloc (sizeof (CoDequeArray) + (size - 1) * sizeof (GCoroutine *));
+  a->size = size;
+
+  return a;
+}
+
+static void
+co_deque_init (CoDeque *d)
+{
+  d->array = co_deque_array_new (CO_DEQUE_MIN_SIZE);
+}
+
+static void
+co_deque_clear (CoDeque *d)
+{
+  g_slist_free_full (d->retired, g_free);
+  g_free (d->array);
+}
+
+/* Called by the owner only */
+static void
+co_deque_push (CoDeque    *d,
+               GCoroutine *co)
+{
+  gint b = d->bottom;
+  gint t = g_atomic_int_get (&d->top);
+  CoDequeArray *a = d->array;
+
+  if (CO_DEQUE_LEN (t, b) >= a->size)
+    {
+      CoDequeArray *grown = co_deque_array_new (a->size * 2);
+      gint i;
+
+      for (i = t; i != b; i = (guint) i + 1)
+        grown->buf[i & (grown->size - 1)] = a->buf[i & (a->size - 1)];
+
+      d->retired = g_slist_prepend (d->retired, a);
+      g_atomic_pointer_set (&d->array, grown);
+      a = grown;
+    }
+
+  a->buf[b & (a->size - 1)] = co;
+  g_atomic_int_set (&d->bottom, (guint) b + 1);
+}
+
+static GCoroutine *
+co_deque_steal (CoDeque *d)
+{
+  for (;;)
+    {
+      gint t = g_atomic_int_get (&d->top);
+      gint b = g_atomic_int_get (&d->bottom);
+      CoDequeArray *a;
+      GCoroutine *co;
+
+      if (CO_DEQUE_LEN (t, b) <= 0)
+        return NULL;
+
+      a = g_atomic_pointer_get (&d->array);
+      co = a->buf[t & (a->size - 1)];
+      if (g_atomic_int_compare_and_exchange (&d->top, t, (guint) t + 1))
+        return co;
+    }
+}
+
+/* Wakes an idle worker up, if any, after some work was queued */
+static void
+co_pool_notify (GCoPool *pool)
+{
+  if (g_atomic_int_get (&pool->n_idle) == 0)
+    return;
+
+  g_mutex_lock (&pool->lock);
+  g_cond_signal (&pool->cond);
+  g_mutex_unlock (&pool->lock);
+}
+
+/* Returns the worker resuming the current coroutine, if it is run by
+ * a pool. This is not a thread-local lookup, since a coroutine may run
+ * in a thread of its own with the gthread implementation. */
+static GCoWorker *
+co_worker_self (void)
+{
+  return g_in_coroutine () ? g_coroutine_self ()->worker : NULL;
+}
+
+/* Called by the worker running @co, or about to */
+static void
+co_worker_push (GCoWorker  *w,
+                GCoroutine *co)
+{
+  if (co->migratable)
+    {
+      co_deque_push (&w->deque, co);
+      co_pool_notify (w->pool);
+    }
+  else
+    {
+      co->run_link.data = co;
+      g_queue_push_tail_link (&w->local, &co->run_link);
+    }
+}
+
+/* Called with the pool lock held */
+static GCoroutine *
+co_pool_pop_injected (GCoPool *pool)
+{
+  GList *link = g_queue_pop_head_link (&pool->injected);
+
+  if (link == NULL)
+    return NULL;
+
+  g_atomic_int_add (&pool->n_injected, -1);
+  return link->data;
+}
+
+/* Queues @co from outside of the workers */
+static void
+co_pool_inject (GCoPool    *pool,
+                GCoroutine *co)
+{
+  g_mutex_lock (&pool->lock);
+  co->run_link.data = co;
+  g_queue_push_tail_link (&pool->injected, &co->run_link);
+  g_atomic_int_inc (&pool->n_injected);
+  g_cond_signal (&pool->cond);
+  g_mutex_unlock (&pool->lock);
+}
+
+/* Called with the pool lock held */
+static GCoroutine *
+co_worker_pop_inbox (GCoWorker *w)
+{
+  GList *link = g_queue_pop_head_link (&w->inbox);
+
+  if (link == NULL)
+    return NULL;
+
+  g_atomic_int_add (&w->n_inbox, -1);
+  return link->data;
+}
+
+/* Queues @co, pinned to @w, from outside of @w */
+static void
+co_worker_inject (GCoWorker  *w,
+                  GCoroutine *co)
+{
+  GCoPool *pool = w->pool;
+
+  g_mutex_lock (&pool->lock);
+  co->run_link.data = co;
+  g_queue_push_tail_link (&w->inbox, &co->run_link);
+  g_atomic_int_inc (&w->n_inbox);
+  /* a signal may wake another idle worker up than @w */
+  g_cond_broadcast (&pool->cond);
+  g_mutex_unlock (&pool->lock);
+}
+
+static GCoroutine *
+co_worker_steal (GCoWorker *w)
+{
+  GCoPool *pool = w->pool;
+  guint i, victim;
+
+  /* xorshift, to spread the thieves over the victims */
+  w->seed ^= w->seed << 13;
+  w->seed ^= w->seed >> 17;
+  w->seed ^= w->seed << 5;
+  victim = w->seed % pool->n_workers;
+
+  for (i = 0; i < pool->n_workers; i++)
+    {
+      GCoWorker *v = &pool->workers[(victim + i) % pool->n_workers];
+      GCoroutine *co;
+
+      if (v != w && (co = co_deque_steal (&v->deque)))
+        return co;
+    }
+
+  return NULL;
+}
+
+/* Returns the next coroutine to run, or %NULL when the pool is freed */
+static GCoroutine *
+co_worker_next (GCoWorker *w)
+{
+  GCoPool *pool = w->pool;
+  GCoroutine *co;
+  GList *link;
+
+  /* alternate between the pinned and the migratable coroutines */
+  if (w->ticks++ & 1 && (link = g_queue_pop_head_link (&w->local)))
+    return link->data;
+  if ((co = co_deque_steal (&w->deque)))
+    return co;
+  if ((link = g_queue_pop_head_link (&w->local)))
+    return link->data;
+
+  if (g_atomic_int_get (&w->n_inbox) > 0)
+    {
+      g_mutex_lock (&pool->lock);
+      co = co_worker_pop_inbox (w);
+      g_mutex_unlock (&pool->lock);
+      if (co)
+        return co;
+    }
+
+  if (g_atomic_int_get (&pool->n_injected) > 0)
+    {
+      g_mutex_lock (&pool->lock);
+      co = co_pool_pop_injected (pool);
+      g_mutex_unlock (&pool->lock);
+      if (co)
+        return co;
+    }
+
+  if ((co = co_worker_steal (w)))
+    return co;
+
+  g_mutex_lock (&pool->lock);
+  g_atomic_int_inc (&pool->n_idle);
+
+  /* look again, now that pushers see this worker idle */
+  while (!(co = co_worker_pop_inbox (w)) &&
+         !(co = co_pool_pop_injected (pool)) &&
+         !(co = co_worker_steal (w)))
+    {
+      if (pool->closing && g_atomic_int_get (&pool->n_coroutines) == 0)
+        break;
+      g_cond_wait (&pool->cond, &pool->lock);
+    }
+
+  g_atomic_int_add (&pool->n_idle, -1);
+  g_mutex_unlock (&pool->lock);
+
+  return co;
+}
+
+static gpointer
+co_worker_run (gpointer data)
+{
+  GCoWorker *w = data;
+  GCoPool *pool = w->pool;
+  GCoroutine *co;
+
+  while ((co = co_worker_next (w)))
+    {
+      gpointer data = co->run_data;
+
+      co->run_data = NULL;
+      co->worker = w;
+      co->last_worker = w;
+      w->yielded = FALSE;
+      g_coroutine_resume (co, data);
+      co->worker = NULL;
+
+      if (w->yielded)
+        {
+          co_worker_push (w, co);
+          continue;
+        }
+
+      /* parked until _g_co_pool_wakeup(), which may have come already */
+      if (g_atomic_int_get (&co->park) != CO_PARK_NONE)
+        {
+          if (g_atomic_int_compare_and_exchange (&co->park, CO_PARK_PARKING,
+                                                 CO_PARK_PARKED))
+            continue;
+
+          g_atomic_int_set (&co->park, CO_PARK_NONE);
+          co_worker_push (w, co);
+          continue;
+        }
+
+      /* the coroutine returned, or left the pool */
+      g_coroutine_unref (co);
+      if (g_atomic_int_dec_and_test (&pool->n_coroutines))
+        {
+          g_mutex_lock (&pool->lock);
+          g_cond_broadcast (&pool->cond);
+          g_mutex_unlock (&pool->lock);
+        }
+    }
+
+  return NULL;
+}
+
+/**
+ * g_co_pool_new:
+ * @n_workers: the number of worker threads, or 0 for one per processor
+ *
+ * Creates a new pool of @n_workers threads running coroutines.
+ *
+ * Returns: (transfer full): a new #GCoPool, free it with g_co_pool_free()
+ **/
+GCoPool *
+g_co_pool_new (guint n_workers)
+{
+  GCoPool *pool;
+  guint i;
+
+  if (n_workers == 0)
+    n_workers = g_get_num_processors ();
+
+  pool = g_slice_new0 (GCoPool);
+  pool->n_workers = n_workers;
+  pool->workers = g_new0 (GCoWorker, n_workers);
+  g_mutex_init (&pool->lock);
+  g_cond_init (&pool->cond);
+  g_queue_init (&pool->injected);
+
+  for (i = 0; i < n_workers; i++)
+    {
+      GCoWorker *w = &pool->workers[i];
+
+      w->pool = pool;
+      w->seed = i + 1;
+      co_deque_init (&w->deque);
+      g_queue_init (&w->local);
+      g_queue_init (&w->inbox);
+    }
+
+  /* start the workers once they can all be stolen from */
+  for (i = 0; i < n_workers; i++)
+    pool->workers[i].thread = g_thread_new ("GCoPool worker", co_worker_run,
+                                            &pool->workers[i]);
+
+  return pool;
+}
+
+/**
+ * g_co_pool_free:
+ * @pool: a #GCoPool
+ *
+ * Waits until all the coroutines added to @pool returned or left it,
+ * then stops the worker threads and frees @pool.
+ **/
+void
+g_co_pool_free (GCoPool *pool)
+{
+  guint i;
+
+  g_return_if_fail (pool != NULL);
+  g_return_if_fail (co_worker_self () == NULL);
+
+  g_mutex_lock (&pool->lock);
+  pool->closing = TRUE;
+  g_cond_broadcast (&pool->cond);
+  g_mutex_unlock (&pool->lock);
+
+  for (i = 0; i < pool->n_workers; i++)
+    {
+      g_thread_join (pool->workers[i].thread);
+      co_deque_clear (&pool->workers[i].deque);
+    }
+
+  g_free (pool->workers);
+  g_mutex_clear (&pool->lock);
+  g_cond_clear (&pool->cond);
+  g_slice_free (GCoPool, pool);
+}
+
+/**
+ * g_co_pool_add:
+ * @pool: a #GCoPool
+ * @coroutine: (transfer full): a #GCoroutine that is not running
+ * @data: the argument to resume @coroutine with
+ *
+ * Adds @coroutine to the run-queue of @pool, taking over the reference
+ * of the caller. When called from a coroutine of @pool, @coroutine is
+ * queued on the same worker, where idle workers may steal it.
+ *
+ * This function is thread-safe.
+ **/
+void
+g_co_pool_add (GCoPool    *pool,
+               GCoroutine *co,
+               gpointer    data)
+{
+  GCoWorker *w = co_worker_self ();
+
+  g_return_if_fail (pool != NULL);
+  g_return_if_fail (co != NULL);
+  g_return_if_fail (!pool->closing || w != NULL);
+
+  co->run_data = data;
+  co->pool = pool;
+  g_atomic_int_inc (&pool->n_coroutines);
+
+  if (w && w->pool == pool)
+    {
+      co_worker_push (w, co);
+      return;
+    }
+
+  co_pool_inject (pool, co);
+}
+
+/**
+ * g_co_pool_yield:
+ *
+ * Puts the current coroutine, which must have been resumed by a
+ * #GCoPool, back in the run-queue of its worker, and yields %NULL to
+ * it. If the coroutine is migratable, it may be resumed by another
+ * worker.
+ **/
+void
+g_co_pool_yield (void) G_COROUTINE_FUNC
+{
+  g_return_if_fail (co_worker_self () != NULL);
+
+  _g_co_pool_yield ();
+}
+
+/* g_co_pool_yield(), if the current coroutine was resumed by a pool */
+gboolean
+_g_co_pool_yield (void) G_COROUTINE_FUNC
+{
+  GCoWorker *w = co_worker_self ();
+
+  if (w == NULL)
+    return FALSE;
+
+  w->yielded = TRUE;
+  g_coroutine_yield (NULL);
+
+  return TRUE;
+}
+
+/* Marks the current coroutine as about to wait for _g_co_pool_wakeup(),
+ * if it was resumed by a pool. Its worker keeps it in the pool. */
+void
+_g_co_pool_park (void) G_COROUTINE_FUNC
+{
+  if (co_worker_self () != NULL)
+    g_atomic_int_set (&g_coroutine_self ()->park, CO_PARK_PARKING);
+}
+
+/* Queues @co, parked with _g_co_pool_park(), on a worker of its pool,
+ * the one that ran it unless it is migratable. Called from any thread,
+ * possibly before @co switched out of its worker: the worker queues it
+ * itself then. */
+void
+_g_co_pool_wakeup (GCoroutine *co)
+{
+  if (g_atomic_int_compare_and_exchange (&co->park, CO_PARK_PARKING,
+                                         CO_PARK_WOKEN))
+    return;
+
+  g_atomic_int_set (&co->park, CO_PARK_NONE);
+  if (co->migratable)
+    co_pool_inject (co->pool, co);
+  else
+    co_worker_inject (co->last_worker, co);
+}
+
+/**
+ * g_coroutine_set_migratable:
+ * @coroutine: a #GCoroutine
+ * @migratable: whether @coroutine may migrate
+ *
+ * Sets whether @coroutine may be resumed by any worker of a #GCoPool,
+ * in any thread, after g_co_pool_yield(). A coroutine must not be made
+ * migratable if it relies on thread-local data, such as #GPrivate or
+ * the thread-default #GMainContext, across yields.
+ **/
+void
+g_coroutine_set_migratable (GCoroutine *co,
+                            gboolean    migratable)
+{
+  g_return_if_fail (co != NULL);
+
+  co->migratable = !!migratable;
+}
+
+/**
+ * g_coroutine_get_migratable:
+ * @coroutine: a #GCoroutine
+ *
+ * Returns: whether @coroutine may migrate between the workers of a
+ * #GCoPool
+ **/
+gboolean
+g_coroutine_get_migratable (GCoroutine *co)
+{
+  g_return_val_if_fail (co != NULL, FALSE);
+
+  return co->migratable;
+}
@@ -0,0 +1,49 @@
+/*
+ * GLib coroutine worker pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __G_CO_POOL_H__
+#define __G_CO_POOL_H__
+
+#if !defined(GCOROUTINE_H_INSIDE) && !defined(GCOROUTINE_COMPILATION)
+#error "Only gcoroutine.h can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+typedef struct _GCoPool GCoPool;
+
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoPool *              g_co_pool_new             (guint          n_workers);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_pool_free            (GCoPool       *pool);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_pool_add             (GCoPool       *pool,
+                                                  GCoroutine    *coroutine,
+                                                  gpointer       data);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_pool_yield           (void) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_coroutine_set_migratable (GCoroutine   *coroutine,
+                                                   gboolean      migratable);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_coroutine_get_migratable (GCoroutine   *coroutine);
+
+G_END_DECLS
+
+#endif /* __G_CO_POOL_H__ */
@@ -0,0 +1,361 @@
+/*
+ * GLib coroutine I/O reactor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcoreactor
+ * @title: I/O reactor
+ * @short_description: waiting for file descriptors with epoll
+ * @see_also: #GMainContext
+ *
+ * The reactor is a minimal alternative to #GMainContext for coroutines
+ * doing I/O on non-blocking file descriptors, on Linux. Each thread has
+ * its own epoll instance: a coroutine waits for a file descriptor with
+ * g_co_wait_fd(), and g_co_reactor_iteration() waits for events and
+ * resumes all the coroutines whose file descriptor is ready at once.
+ *
+ * A file descriptor is registered the first time a coroutine waits
+ * for it, in edge-triggered mode for both directions, and the
+ * registration is kept until g_co_unwatch_fd(), so waiting again costs
+ * no system call. Because of the edge-triggered mode, a coroutine must
+ * only wait after an operation failed with %EAGAIN:
+ *
+ * |[
+ *   while ((n = read (fd, buf, sizeof (buf))) < 0 && errno == EAGAIN)
+ *     if (!g_co_wait_fd (fd, G_IO_IN, end_time))
+ *       return TIMED_OUT;
+ * ]|
+ *
+ * An event received while no coroutine waits is remembered, and the
+ * next wait in the same direction returns right away.
+ *
+ * The reactor is only available when %GCOROUTINE_HAS_EPOLL is 1.
+ */
+
+#define CO_REACTOR_EVENTS 64
+
+enum {
+  CO_FD_IN,
+  CO_FD_OUT,
+};
+
+typedef struct _CoFdWaiter CoFdWaiter;
+
+typedef struct {
+  gint          fd;
+  guint         ready;          /* edges not consumed by a waiter */
+  CoFdWaiter   *waiters[2];
+} CoFd;
+
+struct _CoFdWaiter {
+  GCoroutine   *co;
+  CoFd         *fd;
+  guint         dir;
+  gint64        end_time;
+  GList         timer_link;     /* in the timers of the reactor */
+  gboolean      done;
+  gboolean      ready;
+};
+
+typedef struct {
+  gint          epfd;
+  GHashTable   *fds;            /* fd number -> CoFd */
+  GQueue        timers;         /* sorted by end_time */
+  GPtrArray    *ready;          /* coroutines to resume */
+} CoReactor;
+
+static void
+co_reactor_free (CoReactor *reactor)
+{
+  g_warn_if_fail (g_queue_is_empty (&reactor->timers));
+
+  close (reactor->epfd);
+  g_hash_table_unref (reactor->fds);
+  if (reactor->ready)
+    g_ptr_array_unref (reactor->ready);
+  g_slice_free (CoReactor, reactor);
+}
+
+static GPrivate co_reactor_key = G_PRIVATE_INIT ((GDestroyNotify) co_reactor_free);
+
+static CoReactor *
+co_reactor_get (void)
+{
+  CoReactor *reactor = g_private_get (&co_reactor_key);
+
+  if (G_UNLIKELY (reactor == NULL))
+    {
+      reactor = g_slice_new0 (CoReactor);
+      reactor->epfd = epoll_create1 (EPOLL_CLOEXEC);
+      if (reactor->epfd < 0)
+        g_error ("epoll_create1: %s", g_strerror (errno));
+      reactor->fds = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+      g_queue_init (&reactor->timers);
+      g_private_set (&co_reactor_key, reactor);
+    }
+
+  return reactor;
+}
+
+/* Detaches @waiter, to be resumed by the current iteration */
+static void
+co_reactor_ready (CoReactor  *reactor,
+                  CoFdWaiter *waiter,
+                  gboolean    ready)
+{
+  waiter->fd->waiters[waiter->dir] = NULL;
+  if (waiter->end_time != -1)
+    g_queue_unlink (&reactor->timers, &waiter->timer_link);
+
+  waiter->done = TRUE;
+  waiter->ready = ready;
+
+  /* the waiter is gone as soon as the coroutine runs, which another
+   * coroutine of the batch may do first */
+  if (reactor->ready == NULL)
+    reactor->ready = g_ptr_array_new ();
+  g_ptr_array_add (reactor->ready, g_coroutine_ref (waiter->co));
+}
+
+static void
+co_fd_event (CoReactor *reactor,
+             CoFd      *cofd,
+             guint32    events)
+{
+  guint dir;
+
+  /* errors and hang-ups wake both directions up, the next operation
+   * reports them */
+  if (events & (EPOLLERR | EPOLLHUP))
+    events |= EPOLLIN | EPOLLOUT;
+  if (events & EPOLLRDHUP)
+    events |= EPOLLIN;
+
+  for (dir = CO_FD_IN; dir <= CO_FD_OUT; dir++)
+    {
+      if (!(events & (dir == CO_FD_IN ? EPOLLIN : EPOLLOUT)))
+        continue;
+
+      if (cofd->waiters[dir])
+        co_reactor_ready (reactor, cofd->waiters[dir], TRUE);
+      else
+        cofd->ready |= 1 << dir;
+    }
+}
+
+/**
+ * g_co_wait_fd:
+ * @fd: a non-blocking file descriptor
+ * @condition: %G_IO_IN or %G_IO_OUT
+ * @end_time: the monotonic time to wait until, or -1 to wait forever
+ *
+ * Waits until @fd is ready for @condition, yielding %NULL to the
+ * caller of the current coroutine until g_co_reactor_iteration()
+ * resumes it. At most one coroutine can wait for each direction of
+ * @fd.
+ *
+ * Since @fd is registered in edge-triggered mode, this must only be
+ * called after an operation on @fd failed with %EAGAIN, and it may
+ * return %TRUE for an edge that was already consumed.
+ *
+ * Returns: %TRUE if @fd may be ready, %FALSE if @end_time passed
+ **/
+gboolean
+g_co_wait_fd (gint          fd,
+              GIOCondition  condition,
+              gint64        end_time) G_COROUTINE_FUNC
+{
+  CoReactor *reactor;
+  CoFdWaiter waiter;
+  CoFd *cofd;
+
+  g_return_val_if_fail (fd >= 0, FALSE);
+  g_return_val_if_fail (condition == G_IO_IN || condition == G_IO_OUT, FALSE);
+  g_return_val_if_fail (g_in_coroutine (), FALSE);
+
+  reactor = co_reactor_get ();
+  cofd = g_hash_table_lookup (reactor->fds, GINT_TO_POINTER (fd));
+  if (cofd == NULL)
+    {
+      struct epoll_event ev = { 0, };
+
+      cofd = g_new0 (CoFd, 1);
+      cofd->fd = fd;
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      ev.data.ptr = cofd;
+      if (epoll_ctl (reactor->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+          g_warning ("epoll_ctl: %s", g_strerror (errno));
+          g_free (cofd);
+          return FALSE;
+        }
+      g_hash_table_insert (reactor->fds, GINT_TO_POINTER (fd), cofd);
+    }
+
+  waiter.dir = condition == G_IO_IN ? CO_FD_IN : CO_FD_OUT;
+  g_return_val_if_fail (cofd->waiters[waiter.dir] == NULL, FALSE);
+
+  if (cofd->ready & (1 << waiter.dir))
+    {
+      cofd->ready &= ~(1 << waiter.dir);
+      return TRUE;
+    }
+
+  if (end_time != -1 && end_time <= g_get_monotonic_time ())
+    return FALSE;
+
+  waiter.co = g_coroutine_self ();
+  waiter.fd = cofd;
+  waiter.end_time = end_time;
+  waiter.done = FALSE;
+  waiter.ready = FALSE;
+  cofd->waiters[waiter.dir] = &waiter;
+
+  if (end_time != -1)
+    {
+      guint n = reactor->timers.length;
+      GList *l;
+
+      waiter.timer_link.data = &waiter;
+      waiter.timer_link.prev = waiter.timer_link.next = NULL;
+
+      /* most deadlines are relative to now, search from the end */
+      for (l = reactor->timers.tail; l; l = l->prev, n--)
+        if (((CoFdWaiter *)l->data)->end_time <= end_time)
+          break;
+
+      g_queue_push_nth_link (&reactor->timers, n, &waiter.timer_link);
+    }
+
+  while (!waiter.done)
+    g_coroutine_yield (NULL);
+
+  return waiter.ready;
+}
+
+/**
+ * g_co_unwatch_fd:
+ * @fd: a file descriptor
+ *
+ * Forgets the registration of @fd made by g_co_wait_fd(). This must be
+ * called before closing @fd, since another file opened later could get
+ * the same number. No coroutine may be waiting for @fd.
+ **/
+void
+g_co_unwatch_fd (gint fd)
+{
+  CoReactor *reactor = co_reactor_get ();
+  CoFd *cofd;
+
+  cofd = g_hash_table_lookup (reactor->fds, GINT_TO_POINTER (fd));
+  if (cofd == NULL)
+    return;
+
+  g_return_if_fail (cofd->waiters[CO_FD_IN] == NULL);
+  g_return_if_fail (cofd->waiters[CO_FD_OUT] == NULL);
+
+  epoll_ctl (reactor->epfd, EPOLL_CTL_DEL, fd, NULL);
+  g_hash_table_remove (reactor->fds, GINT_TO_POINTER (fd));
+}
+
+/**
+ * g_co_reactor_iteration:
+ * @may_block: whether the call may block
+ *
+ * Waits for events on the file descriptors of the coroutines waiting in
+ * g_co_wait_fd() in the current thread, or for their deadlines, and
+ * resumes all the coroutines that are ready. If @may_block is %FALSE,
+ * only the events already pending are handled.
+ *
+ * Up to 64 events are handled per call.
+ *
+ * Returns: %TRUE if some coroutines were resumed
+ **/
+gboolean
+g_co_reactor_iteration (gboolean may_block)
+{
+  CoReactor *reactor = co_reactor_get ();
+  struct epoll_event events[CO_REACTOR_EVENTS];
+  GPtrArray *ready;
+  gint i, n, timeout = 0;
+  gint64 now;
+
+  if (may_block)
+    {
+      CoFdWaiter *first = g_queue_peek_head (&reactor->timers);
+
+      timeout = -1;
+      if (first)
+        {
+          gint64 delay = first->end_time - g_get_monotonic_time ();
+
+          /* round up, not to wake up just before the deadline */
+          timeout = CLAMP ((delay + 999) / 1000, 0, G_MAXINT);
+        }
+    }
+
+  n = epoll_wait (reactor->epfd, events, G_N_ELEMENTS (events), timeout);
+  if (n < 0 && errno != EINTR)
+    g_warning ("epoll_wait: %s", g_strerror (errno));
+
+  for (i = 0; i < n; i++)
+    co_fd_event (reactor, events[i].data.ptr, events[i].events);
+
+  now = g_get_monotonic_time ();
+  while (!g_queue_is_empty (&reactor->timers))
+    {
+      CoFdWaiter *waiter = g_queue_peek_head (&reactor->timers);
+
+      if (waiter->end_time > now)
+        break;
+      co_reactor_ready (reactor, waiter, FALSE);
+    }
+
+  /* a resumed coroutine may run an iteration of its own */
+  ready = reactor->ready;
+  reactor->ready = NULL;
+  if (ready == NULL)
+    return FALSE;
+
+  n = ready->len;
+  for (i = 0; i < n; i++)
+    {
+      GCoroutine *co = g_ptr_array_index (ready, i);
+
+      if (!co->terminated && g_coroutine_resumable (co))
+        g_coroutine_resume (co, NULL);
+      g_coroutine_unref (co);
+    }
+
+  g_ptr_array_set_size (ready, 0);
+  if (reactor->ready == NULL)
+    reactor->ready = ready;
+  else
+    g_ptr_array_unref (ready);
+
+  return n > 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * GLib coroutine I/O reactor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __G_CO_REACTOR_H__
+#define __G_CO_REACTOR_H__
+
+#if !defined(GCOROUTINE_H_INSIDE) && !defined(GCOROUTINE_COMPILATION)
+#error "Only gcoroutine.h can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+#if GCOROUTINE_HAS_EPOLL
+
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_wait_fd              (gint          fd,
+                                                  GIOCondition  condition,
+                                                  gint64        end_time) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_unwatch_fd           (gint          fd);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_reactor_iteration    (gboolean      may_block);
+
+#endif /* GCOROUTINE_HAS_EPOLL */
+
+G_END_DECLS
+
+#endif /* __G_CO_REACTOR_H__ */
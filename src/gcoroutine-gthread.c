@@ -21,6 +21,8 @@
 #include "config.h"
 #include "gcoroutineprivate.h"
 
+#include <string.h>
+
 typedef struct {
   GCoroutine       base;
 
@@ -30,6 +32,8 @@ typedef struct {
   GCoroutineAction action;
 } GRealCoroutine;
 
+G_STATIC_ASSERT(sizeof(GRealCoroutine) <= sizeof(GCoroutineStorage));
+
 static GMutex coroutine_lock;
 static GCond coroutine_cond;
 
@@ -95,8 +99,7 @@ coroutine_thread (gpointer opaque)
 
     set_coroutine_key (co, FALSE);
     coroutine_wait_runnable (co);
-    g_coroutine_ref (coro);
-    co->base.data = co->base.func (co->base.data);
+    _g_coroutine_run (coro);
     _g_coroutine_switch (&co->base, co->base.caller, GCOROUTINE_TERMINATE);
 
     return NULL;
@@ -113,13 +116,54 @@ _g_coroutine_new (void)
     return (GCoroutine *)co;
 }
 
+/* Threads have their own stack, @stack is not used */
+GCoroutine *
+_g_coroutine_init_static (GCoroutineStorage *storage,
+                          gpointer           stack,
+                          gsize              stack_size)
+{
+    GRealCoroutine *co = (GRealCoroutine *)storage;
+
+    memset (co, 0, sizeof (GRealCoroutine));
+    co->base.is_static = TRUE;
+    co->thread = g_thread_new ("coroutine", coroutine_thread, co);
+
+    return (GCoroutine *)co;
+}
+
+void
+_g_coroutine_new_batch (GCoroutine **coroutines,
+                        guint        n)
+{
+    GCoroutineBatch *batch;
+    GRealCoroutine *cos;
+    gsize header;
+    guint i;
+
+    header = (sizeof (GCoroutineBatch) + G_MEM_ALIGN - 1) & ~(gsize)(G_MEM_ALIGN - 1);
+    batch = g_malloc0 (header + n * sizeof (GRealCoroutine));
+    batch->ref_count = n;
+    cos = (GRealCoroutine *)((guint8 *)batch + header);
+
+    for (i = 0; i < n; i++)
+      {
+        GRealCoroutine *co = &cos[i];
+
+        co->base.is_static = TRUE;
+        co->base.batch = batch;
+        co->thread = g_thread_new ("coroutine", coroutine_thread, co);
+        coroutines[i] = (GCoroutine *)co;
+      }
+}
+
 void
 _g_coroutine_free (GCoroutine *co_)
 {
   GRealCoroutine *co = (GRealCoroutine *)co_;
 
   g_thread_join (co->thread);
-  g_slice_free (GRealCoroutine, co);
+  if (!co->base.is_static)
+    g_slice_free (GRealCoroutine, co);
 }
 
 GCoroutineAction
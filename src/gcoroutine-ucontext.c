@@ -29,6 +29,7 @@
 #include "valgrind.h"
 
 #include <errno.h>
+#include <string.h>
 #include <setjmp.h>
 #include <ucontext.h>
 
@@ -36,10 +37,13 @@ typedef struct {
   GCoroutine       base;
 
   gpointer         stack;
+  gboolean         own_stack;
   sigjmp_buf       env;
   unsigned int     valgrind_stack_id;
 } GRealCoroutine;
 
+G_STATIC_ASSERT(sizeof(GRealCoroutine) <= sizeof(GCoroutineStorage));
+
 /**
  * Per-thread coroutine bookkeeping
  */
@@ -98,6 +102,8 @@ _g_coroutine_switch (GCoroutine *from_, GCoroutine *to_,
       siglongjmp (to->env, action);
     }
 
+  /* @from may be resumed from another thread, which already set its
+   * own s->current: @s must not be used past this point */
   return ret;
 }
 
@@ -121,21 +127,14 @@ coroutine_trampoline (int i0, int i1)
 
   while (1)
     {
-      g_coroutine_ref (co);
-      co->data = co->func (co->data);
+      _g_coroutine_run (co);
       _g_coroutine_switch (co, co->caller, GCOROUTINE_TERMINATE);
     }
 }
 
-GCoroutine *
-_g_coroutine_new (void)
+static void
+coroutine_getcontext (ucontext_t *uc)
 {
-  GRealCoroutine *co;
-  const size_t stack_size = 1 << 20;
-  ucontext_t old_uc, uc;
-  sigjmp_buf old_env;
-  union cc_arg arg = { 0 };
-
   /* The ucontext functions preserve signal masks which incurs a
    * system call overhead.  sigsetjmp(buf, 0)/siglongjmp() does not
    * preserve signal masks but only works on the current stack.
@@ -143,35 +142,120 @@ _g_coroutine_new (void)
    * the ucontext functions for that but sigsetjmp()/siglongjmp() for
    * everything else.
    */
-  if (getcontext (&uc) == -1)
+  if (getcontext (uc) == -1)
     {
       g_error ("getcontext failed: %s", g_strerror (errno));
     }
+}
+
+/* @uc is a template filled by coroutine_getcontext(), it may be
+ * reused to initialize several coroutines in a row */
+static void
+coroutine_init (GRealCoroutine *co, ucontext_t *uc, gsize stack_size)
+{
+  ucontext_t old_uc;
+  sigjmp_buf old_env;
+  union cc_arg arg = { 0 };
 
-  co = g_slice_new0 (GRealCoroutine);
-  co->stack = g_malloc (stack_size);
   co->base.data = &old_env; /* stash away our jmp_buf */
-  uc.uc_link = &old_uc;
-  uc.uc_stack.ss_sp = co->stack;
-  uc.uc_stack.ss_size = stack_size;
-  uc.uc_stack.ss_flags = 0;
+  uc->uc_link = &old_uc;
+  uc->uc_stack.ss_sp = co->stack;
+  uc->uc_stack.ss_size = stack_size;
+  uc->uc_stack.ss_flags = 0;
 
   co->valgrind_stack_id =
     VALGRIND_STACK_REGISTER (co->stack, co->stack + stack_size);
 
   arg.p = co;
-  makecontext (&uc, (void (*)(void))coroutine_trampoline,
+  makecontext (uc, (void (*)(void))coroutine_trampoline,
                2, arg.i[0], arg.i[1]);
 
   /* swapcontext() in, siglongjmp() back out */
   if (!sigsetjmp (old_env, 0))
     {
-      swapcontext (&old_uc, &uc);
+      swapcontext (&old_uc, uc);
     }
+}
+
+GCoroutine *
+_g_coroutine_new (void)
+{
+  GRealCoroutine *co;
+  ucontext_t uc;
+
+  coroutine_getcontext (&uc);
+
+  co = g_slice_new0 (GRealCoroutine);
+  co->stack = g_malloc (G_COROUTINE_STACK_SIZE);
+  co->own_stack = TRUE;
+  coroutine_init (co, &uc, G_COROUTINE_STACK_SIZE);
 
   return (GCoroutine *)co;
 }
 
+GCoroutine *
+_g_coroutine_init_static (GCoroutineStorage *storage,
+                          gpointer           stack,
+                          gsize              stack_size)
+{
+  GRealCoroutine *co = (GRealCoroutine *)storage;
+  ucontext_t uc;
+
+  coroutine_getcontext (&uc);
+
+  memset (co, 0, sizeof (GRealCoroutine));
+  co->base.is_static = TRUE;
+
+  if (stack == NULL)
+    {
+      stack_size = G_COROUTINE_STACK_SIZE;
+      stack = g_malloc (stack_size);
+      co->own_stack = TRUE;
+    }
+
+  co->stack = stack;
+  coroutine_init (co, &uc, stack_size);
+
+  return (GCoroutine *)co;
+}
+
+/* A single block holds the batch header, followed by the coroutine
+ * control blocks, followed by the stacks. */
+void
+_g_coroutine_new_batch (GCoroutine **coroutines,
+                        guint        n)
+{
+  GCoroutineBatch *batch;
+  GRealCoroutine *cos;
+  guint8 *stacks;
+  ucontext_t uc;
+  gsize header;
+  guint i;
+
+  header = (sizeof (GCoroutineBatch) + G_MEM_ALIGN - 1) & ~(gsize)(G_MEM_ALIGN - 1);
+  batch = g_malloc (header +
+                    n * sizeof (GRealCoroutine) +
+                    (gsize) n * G_COROUTINE_STACK_SIZE);
+  batch->ref_count = n;
+  cos = (GRealCoroutine *)((guint8 *)batch + header);
+  stacks = (guint8 *)(cos + n);
+  memset (cos, 0, n * sizeof (GRealCoroutine));
+
+  /* getcontext() costs a system call, do it only once */
+  coroutine_getcontext (&uc);
+
+  for (i = 0; i < n; i++)
+    {
+      GRealCoroutine *co = &cos[i];
+
+      co->base.is_static = TRUE;
+      co->base.batch = batch;
+      co->stack = stacks + (gsize) i * G_COROUTINE_STACK_SIZE;
+      coroutine_init (co, &uc, G_COROUTINE_STACK_SIZE);
+      coroutines[i] = (GCoroutine *)co;
+    }
+}
+
 #ifdef CONFIG_PRAGMA_DIAGNOSTIC_AVAILABLE
 /* Work around an unused variable in the valgrind.h macro... */
 #pragma GCC diagnostic push
@@ -193,8 +277,10 @@ _g_coroutine_free (GCoroutine *co_)
 
   valgrind_stack_deregister (co);
 
-  g_free (co->stack);
-  g_slice_free (GRealCoroutine, co);
+  if (co->own_stack)
+    g_free (co->stack);
+  if (!co->base.is_static)
+    g_slice_free (GRealCoroutine, co);
 }
 
 GCoroutine *
@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include <windows.h>
+#include <string.h>
 
 #include "gcoroutineprivate.h"
 
@@ -35,6 +36,8 @@ typedef struct {
   GCoroutineAction  action;
 } GRealCoroutine;
 
+G_STATIC_ASSERT(sizeof(GRealCoroutine) <= sizeof(GCoroutineStorage));
+
 static __thread GRealCoroutine leader;
 static __thread GCoroutine *current;
 
@@ -60,8 +63,7 @@ coroutine_trampoline (void *co_)
 
   while (1)
     {
-      g_coroutine_ref (co);
-      co->data = co->func (co->data);
+      _g_coroutine_run (co);
       _g_coroutine_switch (co, co->caller, GCOROUTINE_TERMINATE);
     }
 }
@@ -69,22 +71,65 @@ coroutine_trampoline (void *co_)
 GCoroutine *
 _g_coroutine_new (void)
 {
-  const size_t stack_size = 1 << 20;
   GRealCoroutine *co;
 
   co = g_slice_new0 (GRealCoroutine);
+  co->fiber = CreateFiber (G_COROUTINE_STACK_SIZE, coroutine_trampoline, co);
+
+  return (GCoroutine*)co;
+}
+
+/* Fibers allocate their own stack, only @stack_size is honoured */
+GCoroutine *
+_g_coroutine_init_static (GCoroutineStorage *storage,
+                          gpointer           stack,
+                          gsize              stack_size)
+{
+  GRealCoroutine *co = (GRealCoroutine*)storage;
+
+  if (stack == NULL)
+    stack_size = G_COROUTINE_STACK_SIZE;
+
+  memset (co, 0, sizeof (GRealCoroutine));
+  co->base.is_static = TRUE;
   co->fiber = CreateFiber (stack_size, coroutine_trampoline, co);
 
   return (GCoroutine*)co;
 }
 
+void
+_g_coroutine_new_batch (GCoroutine **coroutines,
+                        guint        n)
+{
+  GCoroutineBatch *batch;
+  GRealCoroutine *cos;
+  gsize header;
+  guint i;
+
+  header = (sizeof (GCoroutineBatch) + G_MEM_ALIGN - 1) & ~(gsize)(G_MEM_ALIGN - 1);
+  batch = g_malloc0 (header + n * sizeof (GRealCoroutine));
+  batch->ref_count = n;
+  cos = (GRealCoroutine*)((guint8 *)batch + header);
+
+  for (i = 0; i < n; i++)
+    {
+      GRealCoroutine *co = &cos[i];
+
+      co->base.is_static = TRUE;
+      co->base.batch = batch;
+      co->fiber = CreateFiber (G_COROUTINE_STACK_SIZE, coroutine_trampoline, co);
+      coroutines[i] = (GCoroutine*)co;
+    }
+}
+
 void
 _g_coroutine_free (GCoroutine *co_)
 {
   GRealCoroutine *co = (GRealCoroutine*)co_;
 
   DeleteFiber (co->fiber);
-  g_slice_free (GRealCoroutine, co);
+  if (!co->base.is_static)
+    g_slice_free (GRealCoroutine, co);
 }
 
 GCoroutine *
@@ -99,6 +99,66 @@ coroutine_resume_queue (GCoroutine *co) G_COROUTINE_FUNC
   g_queue_clear (&resume_queue);
 }
 
+static GMutex          co_private_lock;
+static gint            co_private_n;
+static GDestroyNotify  co_private_notify[G_CO_PRIVATE_MAX];
+
+/* Run the destroy notifiers of the coroutine-local values */
+static void
+coroutine_private_clear (GCoroutine *co)
+{
+  gint i, n = g_atomic_int_get (&co_private_n);
+
+  for (i = 0; i < n; i++)
+    {
+      gpointer value = co->privates[i];
+
+      co->privates[i] = NULL;
+      if (value && co_private_notify[i])
+        co_private_notify[i] (value);
+    }
+}
+
+struct _GCoArenaChunk {
+  GCoArenaChunk *next;
+  gsize          size;
+  gsize          used;
+};
+
+#define CO_ARENA_CHUNK_SIZE 4096
+#define CO_ARENA_ALIGN(n) (((n) + G_MEM_ALIGN - 1) & ~(gsize)(G_MEM_ALIGN - 1))
+#define CO_ARENA_HEADER CO_ARENA_ALIGN (sizeof (GCoArenaChunk))
+
+static void
+coroutine_arena_clear (GCoroutine *co)
+{
+  GCoArenaChunk *chunk = co->arena;
+
+  co->arena = NULL;
+  while (chunk)
+    {
+      GCoArenaChunk *next = chunk->next;
+
+      g_free (chunk);
+      chunk = next;
+    }
+}
+
+/* Called by the implementations on the coroutine stack, the caller
+ * then switches back with GCOROUTINE_TERMINATE */
+void
+_g_coroutine_run (GCoroutine *co) G_COROUTINE_FUNC
+{
+  g_coroutine_ref (co);
+  co->data = co->func (co->data);
+  coroutine_private_clear (co);
+  coroutine_arena_clear (co);
+
+  /* resumed once the coroutine switched back for the last time */
+  co->terminated = TRUE;
+  g_co_queue_schedule (&co->joiners, -1);
+}
+
 static gpointer
 coroutine_swap (GCoroutine *from, GCoroutine *to, gpointer data)
 {
@@ -121,6 +181,106 @@ coroutine_swap (GCoroutine *from, GCoroutine *to, gpointer data)
   }
 }
 
+struct _GCoHome {
+  gint          ref_count;
+  GMainContext *context;
+  GSource      *source;           /* attached on the first wakeup */
+  GCoroutine   *wakeups;          /* lock-free stack of coroutines */
+};
+
+typedef struct {
+  GSource       source;
+  GCoHome      *home;
+} CoHomeSource;
+
+static void
+co_home_unref (GCoHome *home)
+{
+  if (!g_atomic_int_dec_and_test (&home->ref_count))
+    return;
+
+  g_warn_if_fail (home->wakeups == NULL);
+  if (home->source)
+    {
+      g_source_destroy (home->source);
+      g_source_unref (home->source);
+    }
+  g_main_context_unref (home->context);
+  g_slice_free (GCoHome, home);
+}
+
+static GPrivate co_home_key = G_PRIVATE_INIT ((GDestroyNotify) co_home_unref);
+
+static GCoHome *
+co_home_ref_current (void)
+{
+  GCoHome *home = g_private_get (&co_home_key);
+
+  if (G_UNLIKELY (home == NULL))
+    {
+      home = g_slice_new0 (GCoHome);
+      home->ref_count = 1;
+      home->context = g_main_context_ref_thread_default ();
+      g_private_set (&co_home_key, home);
+    }
+
+  g_atomic_int_inc (&home->ref_count);
+
+  return home;
+}
+
+static gboolean
+co_home_dispatch (GSource     *source,
+                  GSourceFunc  callback,
+                  gpointer     user_data)
+{
+  GCoHome *home = ((CoHomeSource *)source)->home;
+  GCoroutine *co, *list = NULL;
+
+  /* a wakeup racing with this makes the source ready again */
+  g_source_set_ready_time (source, -1);
+  do
+    co = g_atomic_pointer_get (&home->wakeups);
+  while (!g_atomic_pointer_compare_and_exchange (&home->wakeups, co, NULL));
+
+  /* the stack is LIFO, resume in the order of the wakeups */
+  while (co)
+    {
+      GCoroutine *next = co->wakeup_next;
+
+      co->wakeup_next = list;
+      list = co;
+      co = next;
+    }
+
+  while (list)
+    {
+      co = list;
+      list = co->wakeup_next;
+      co->wakeup_next = NULL;
+      g_coroutine_resume (co, NULL);
+      g_coroutine_unref (co);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs co_home_funcs = {
+  NULL,
+  NULL,
+  co_home_dispatch,
+  NULL
+};
+
+static void
+coroutine_init (GCoroutine *co, GCoroutineFunc func)
+{
+  co->func = func;
+  co->ref_count = 1;
+  g_queue_init (&co->resume_queue);
+  g_co_queue_init (&co->joiners);
+}
+
 /**
  * g_coroutine_new:
  * @func: a function to execute in the new coroutine
@@ -144,9 +304,92 @@ g_coroutine_new (GCoroutineFunc func)
   g_return_val_if_fail (func != NULL, NULL);
 
   co = _g_coroutine_new ();
-  co->func = func;
-  co->ref_count = 1;
-  g_queue_init (&co->resume_queue);
+  coroutine_init (co, func);
+
+  return co;
+}
+
+/**
+ * g_coroutine_new_batch:
+ * @func: a function to execute in the new coroutines
+ * @n: the number of coroutines to create
+ * @coroutines: (out caller-allocates) (array length=n): return location
+ *     for the @n new #GCoroutine
+ *
+ * This function creates @n coroutines running @func at once, like
+ * calling g_coroutine_new() @n times. The coroutine control blocks and
+ * stacks are carved out of a single allocation and the per-coroutine
+ * setup cost is shared where the implementation allows it, which makes
+ * it cheaper to spawn a burst of coroutines.
+ *
+ * Each coroutine must be released with g_coroutine_unref(). The memory
+ * of the batch is freed when the last of them is released.
+ **/
+void
+g_coroutine_new_batch (GCoroutineFunc func,
+                       guint          n,
+                       GCoroutine   **coroutines)
+{
+  guint i;
+
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (coroutines != NULL || n == 0);
+
+  if (n == 0)
+    return;
+
+  _g_coroutine_new_batch (coroutines, n);
+  for (i = 0; i < n; i++)
+    coroutine_init (coroutines[i], func);
+}
+
+/**
+ * GCoroutineStorage:
+ *
+ * The #GCoroutineStorage struct is an opaque data structure large
+ * enough to hold a #GCoroutine. It can be embedded in another
+ * structure or allocated statically, and initialized with
+ * g_coroutine_init_static().
+ */
+
+/**
+ * g_coroutine_init_static:
+ * @storage: a #GCoroutineStorage to hold the coroutine
+ * @stack: (allow-none): memory to use as the coroutine stack, or %NULL
+ * @stack_size: the size of @stack in bytes
+ * @func: a function to execute in the new coroutine
+ *
+ * This function creates a new coroutine like g_coroutine_new(), but
+ * builds it in caller-provided memory. The coroutine control block is
+ * placed in @storage and, if @stack is not %NULL, @stack is used as
+ * the coroutine stack. With the ucontext implementation, no memory is
+ * allocated or freed by the library during the coroutine lifetime.
+ * Other implementations ignore @stack and allocate their own.
+ *
+ * If @stack is %NULL, a stack of the default size is allocated and
+ * freed with the coroutine.
+ *
+ * The returned coroutine is reference counted like any other. When the
+ * last reference is dropped, its resources are released but @storage
+ * and @stack are left untouched: the caller must keep them around
+ * until then, and is responsible for freeing them afterwards.
+ *
+ * Returns: the new #GCoroutine, pointing to @storage
+ **/
+GCoroutine *
+g_coroutine_init_static (GCoroutineStorage *storage,
+                         gpointer           stack,
+                         gsize              stack_size,
+                         GCoroutineFunc     func)
+{
+  GCoroutine *co;
+
+  g_return_val_if_fail (storage != NULL, NULL);
+  g_return_val_if_fail (stack == NULL || stack_size > 0, NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  co = _g_coroutine_init_static (storage, stack, stack_size);
+  coroutine_init (co, func);
 
   return co;
 }
@@ -188,9 +431,68 @@ g_coroutine_unref (GCoroutine *co)
 
   if (g_atomic_int_dec_and_test (&co->ref_count))
     {
+      GCoroutineBatch *batch = co->batch;
+
       g_warn_if_fail (g_queue_is_empty (&co->resume_queue));
+      /* unless the function returned, it was released while suspended */
+      coroutine_private_clear (co);
+      coroutine_arena_clear (co);
+      if (co->home)
+        co_home_unref (co->home);
       _g_coroutine_free (co);
+
+      if (batch && g_atomic_int_dec_and_test (&batch->ref_count))
+        g_free (batch);
+    }
+}
+
+/**
+ * g_coroutine_wakeup:
+ * @coroutine: a suspended #GCoroutine
+ *
+ * Schedules @coroutine to be resumed with %NULL by the main context of
+ * the thread that first resumed it, that is the thread-default
+ * #GMainContext of that thread when it first resumed a coroutine.
+ *
+ * Unlike the other scheduling functions, this function can be called
+ * from any thread, for example once a worker thread completed an
+ * operation @coroutine yielded for. The coroutines woken up are pushed
+ * on a lock-free queue of their home thread, and its main context is
+ * woken up only for the first of them until it runs them, in the order
+ * of their wakeups.
+ *
+ * @coroutine must have been resumed before, and must not be woken up
+ * again until it has been resumed.
+ **/
+void
+g_coroutine_wakeup (GCoroutine *co)
+{
+  GCoHome *home;
+  GCoroutine *head;
+
+  g_return_if_fail (co != NULL);
+  g_return_if_fail (co->home != NULL);
+
+  home = co->home;
+  if (g_once_init_enter (&home->source))
+    {
+      GSource *source = g_source_new (&co_home_funcs, sizeof (CoHomeSource));
+
+      ((CoHomeSource *)source)->home = home;
+      g_source_attach (source, home->context);
+      g_once_init_leave (&home->source, source);
+    }
+
+  g_coroutine_ref (co);
+  do
+    {
+      head = g_atomic_pointer_get (&home->wakeups);
+      co->wakeup_next = head;
     }
+  while (!g_atomic_pointer_compare_and_exchange (&home->wakeups, head, co));
+
+  if (head == NULL)
+    g_source_set_ready_time (home->source, 0);
 }
 
 /**
@@ -211,6 +513,58 @@ g_coroutine_resumable (GCoroutine *co)
   return co->caller == NULL;
 }
 
+/**
+ * GCoPriority:
+ * @G_CO_PRIORITY_HIGH: for latency-sensitive coroutines
+ * @G_CO_PRIORITY_DEFAULT: the priority of new coroutines
+ * @G_CO_PRIORITY_LOW: for bulk work
+ *
+ * The priority class of a coroutine. Coroutines of a higher priority
+ * go first in the run-queue of a scheduler and in the wait queue of a
+ * #GCoQueue, and thus of the locks built on it. To keep lower priority
+ * coroutines progressing, they are served anyway once they were passed
+ * over %G_CO_PRIORITY_AGING times.
+ */
+
+/**
+ * G_CO_PRIORITY_AGING:
+ *
+ * How many times a coroutine can be passed over by coroutines of a
+ * higher priority before it is served first.
+ */
+
+/**
+ * g_coroutine_set_priority:
+ * @coroutine: a #GCoroutine
+ * @priority: a #GCoPriority
+ *
+ * Sets the priority class of @coroutine, which is taken into account
+ * the next time it is queued.
+ **/
+void
+g_coroutine_set_priority (GCoroutine  *co,
+                          GCoPriority  priority)
+{
+  g_return_if_fail (co != NULL);
+  g_return_if_fail (priority >= G_CO_PRIORITY_HIGH && priority <= G_CO_PRIORITY_LOW);
+
+  co->priority = priority;
+}
+
+/**
+ * g_coroutine_get_priority:
+ * @coroutine: a #GCoroutine
+ *
+ * Returns: the priority class of @coroutine
+ **/
+GCoPriority
+g_coroutine_get_priority (GCoroutine *co)
+{
+  g_return_val_if_fail (co != NULL, G_CO_PRIORITY_DEFAULT);
+
+  return co->priority;
+}
+
 /**
  * g_coroutine_resume:
  * @coroutine: a #GCoroutine
@@ -234,6 +588,11 @@ g_coroutine_resume (GCoroutine *co, gpointer data)
   g_return_val_if_fail (co != NULL, NULL);
   g_return_val_if_fail (co->caller == NULL, NULL);
 
+  /* the home is only needed by g_coroutine_wakeup(), which requires
+   * the coroutine to have been resumed */
+  if (G_UNLIKELY (co->home == NULL))
+    co->home = co_home_ref_current ();
+
   co->caller = self;
   return coroutine_swap (self, co, data);
 }
@@ -245,7 +604,8 @@ g_coroutine_resume (GCoroutine *co, gpointer data)
  * Yields control back to the caller of g_coroutine_resume().
  *
  * Returns: the argument supplied by the caller in
- * g_coroutine_resume()
+ * g_coroutine_resume(), or %NULL if the current coroutine was
+ * cancelled, see g_coroutine_cancel()
  **/
 gpointer
 g_coroutine_yield (gpointer data) G_COROUTINE_FUNC
@@ -256,208 +616,1498 @@ g_coroutine_yield (gpointer data) G_COROUTINE_FUNC
   g_return_val_if_fail (to != NULL, NULL);
 
   self->caller = NULL;
-  return coroutine_swap (self, to, data);
-}
+  to->data = data;
+  _g_coroutine_switch (self, to, GCOROUTINE_YIELD);
 
-/**
- * g_coroutine_self:
- *
- * This functions returns the #GCoroutine corresponding to the current
- * coroutine. Note that this function does not increase the reference
- * count of the returned struct.
- *
- * Returns: the #GCoroutine representing the current coroutine
- **/
-GCoroutine *
-g_coroutine_self (void) G_COROUTINE_FUNC
-{
-  return _g_coroutine_self ();
-}
+  /* the coroutine may be resumed by another caller than @to, in
+   * another thread if it migrated: drain the queue of the new one */
+  coroutine_resume_queue (self->caller);
 
-/**
- * g_in_coroutine:
- *
- * This function returns %TRUE if the current context of execution is
- * from a coroutine.
- *
- * Returns: %TRUE if called from a coroutine context
- **/
-gboolean
-g_in_coroutine (void)
-{
-  return _g_in_coroutine ();
+  return self->data;
 }
 
 /**
- * GCoQueue:
+ * g_co_async_ready:
+ * @source_object: (nullable): the source object of the operation
+ * @result: the #GAsyncResult of the operation
+ * @coroutine: the #GCoroutine waiting in g_co_async_yield()
  *
- * The #GCoQueue struct is an opaque data structure to queue
- * coroutines. It provides the fundamental primitives on which
- * coroutine locks are built.
- */
-
-/**
- * g_co_queue_init:
- * @queue: a #GCoQueue
+ * A #GAsyncReadyCallback resuming @coroutine, which must be given as
+ * user data to the asynchronous function, along with this function
+ * casted to #GAsyncReadyCallback:
  *
- * Initializes a #GCoQueue so that it can be used.
+ * |[
+ *   g_file_read_async (file, G_PRIORITY_DEFAULT, NULL,
+ *                      (GAsyncReadyCallback) g_co_async_ready,
+ *                      g_coroutine_self ());
+ *   stream = g_file_read_finish (file, g_co_async_yield (), &error);
+ * ]|
+ *
+ * No closure is allocated: @result is kept in @coroutine until it
+ * returns from g_co_async_yield().
  **/
 void
-g_co_queue_init (GCoQueue *q)
+g_co_async_ready (gpointer source_object,
+                  gpointer result,
+                  gpointer coroutine)
 {
-  g_return_if_fail (q != NULL);
+  GCoroutine *co = coroutine;
 
-  g_queue_init (&q->queue);
+  g_return_if_fail (co != NULL);
+  g_return_if_fail (result != NULL);
+  g_return_if_fail (co->async_result == NULL);
+
+  co->async_result = result;
+  g_coroutine_resume (co, NULL);
 }
 
 /**
- * g_co_queue_yield:
- * @queue: a #GCoQueue
- * @data: an argument to return to the caller context
+ * g_co_async_yield:
  *
- * Yields control back to the caller of g_coroutine_resume().
+ * Yields %NULL to the caller of the current coroutine until the
+ * asynchronous operation started with g_co_async_ready() as callback
+ * completes.
  *
- * Returns: the argument supplied by the caller in
- * g_coroutine_resume()
+ * The operation must complete in the thread of the current coroutine,
+ * which is the case for GIO operations started from it, as long as its
+ * thread-default #GMainContext is iterated.
+ *
+ * Returns: (transfer none): the #GAsyncResult of the operation, which
+ * is only valid until the current coroutine yields again, so it should
+ * be passed to the matching finish function right away
  **/
 gpointer
-g_co_queue_yield (GCoQueue *q, gpointer data) G_COROUTINE_FUNC
+g_co_async_yield (void) G_COROUTINE_FUNC
 {
-  g_return_val_if_fail (q != NULL, NULL);
+  GCoroutine *self = g_coroutine_self ();
+  gpointer result;
+
   g_return_val_if_fail (g_in_coroutine (), NULL);
 
-  g_queue_push_tail (&q->queue, g_coroutine_self ());
-  return g_coroutine_yield (data);
+  while (self->async_result == NULL)
+    g_coroutine_yield (NULL);
+
+  result = self->async_result;
+  self->async_result = NULL;
+
+  return result;
 }
 
 /**
- * g_co_queue_schedule:
- * @queue: a #GCoQueue
- * @n: number of coroutines to schedule
+ * g_coroutine_join:
+ * @coroutine: a #GCoroutine
  *
- * Pop @n coroutines from the @queue and schedule them for execution.
+ * Waits for @coroutine to terminate. If its function did not return
+ * yet, the current coroutine will yield %NULL, and it is resumed only
+ * once @coroutine has terminated.
  *
- * Returns: the number of coroutines scheduled
+ * Returns: the value returned by the function of @coroutine, or %NULL
+ * if the current coroutine was cancelled before
  **/
-gint
-g_co_queue_schedule (GCoQueue *q, gint n) G_COROUTINE_FUNC
+gpointer
+g_coroutine_join (GCoroutine *co) G_COROUTINE_FUNC
 {
   GCoroutine *self = g_coroutine_self ();
-  gint i;
+  gpointer data;
 
-  g_return_val_if_fail (q != NULL, -1);
-  g_return_val_if_fail (n >= -1, -1);
+  g_return_val_if_fail (co != NULL, NULL);
+  g_return_val_if_fail (g_in_coroutine (), NULL);
+  g_return_val_if_fail (co != self, NULL);
 
-  for (i = 0; (n == -1 || i < n) && !g_queue_is_empty (&q->queue); i++)
+  g_coroutine_ref (co);
+  while (!co->terminated && !self->cancelled)
     {
-      g_queue_push_tail (&self->resume_queue, g_queue_pop_head (&q->queue));
+      data = g_co_queue_yield (&co->joiners, NULL);
+      g_warn_if_fail (data == NULL);
     }
 
-  return i;
+  data = co->terminated ? co->data : NULL;
+  g_coroutine_unref (co);
+
+  return data;
 }
 
 /**
- * g_co_queue_resume_head:
- * @queue: a #GCoQueue
- * @data: an argument to return to the caller context
+ * g_coroutine_cancel:
+ * @coroutine: a #GCoroutine
  *
- * Resume the first coroutine from the @queue.
+ * Cancels @coroutine. If it is blocked on a #GCoQueue, and so in any
+ * of the coroutine locks or channels, or in g_co_sleep(), it is
+ * removed from there and resumed right away with %NULL, and the call
+ * it was blocked in reports the cancellation, for instance
+ * g_co_mutex_lock() returns %FALSE. From then on, these calls return
+ * right away instead of blocking @coroutine, which is expected to
+ * clean up and return.
  *
- * Returns: the argument returned by the head coroutine
+ * Cancellation is cooperative: a coroutine blocked by other means,
+ * such as g_coroutine_yield() or a %G_CO_MUTEX_THREAD_SAFE mutex, is
+ * not resumed, and may check g_coroutine_is_cancelled() itself.
+ *
+ * This must be called from the thread @coroutine runs in. A
+ * #GCancellable of that thread can cancel a coroutine with a handler:
+ *
+ * |[
+ *   static void
+ *   cancelled_cb (GCancellable *cancellable,
+ *                 gpointer      coroutine)
+ *   {
+ *     g_coroutine_cancel (coroutine);
+ *   }
+ *
+ *   id = g_cancellable_connect (cancellable, G_CALLBACK (cancelled_cb),
+ *                               coroutine, NULL);
+ * ]|
  **/
-gpointer
-g_co_queue_resume_head (GCoQueue *q, gpointer data)
+void
+g_coroutine_cancel (GCoroutine *co)
 {
-  GCoroutine *co;
-
-  g_return_val_if_fail (q != NULL, NULL);
-  g_return_val_if_fail (!g_queue_is_empty (&q->queue), NULL);
+  g_return_if_fail (co != NULL);
 
-  co = g_queue_pop_head (&q->queue);
-  g_return_val_if_fail (co != NULL, NULL);
+  co->cancelled = TRUE;
 
-  return g_coroutine_resume (co, data);
+  /* the blocking call detaches it when resumed */
+  if (co->cancellable)
+    {
+      co->cancellable = FALSE;
+      g_coroutine_resume (co, NULL);
+    }
 }
 
 /**
- * g_co_queue_is_empty:
- * @queue: a #GCoQueue
+ * g_coroutine_is_cancelled:
+ * @coroutine: a #GCoroutine
  *
- * Returns %TRUE if the queue is empty.
+ * Returns whether @coroutine was cancelled with g_coroutine_cancel().
  *
- * Returns: %TRUE if the queue is empty
+ * Returns: %TRUE if @coroutine was cancelled
  **/
 gboolean
-g_co_queue_is_empty (GCoQueue *q)
+g_coroutine_is_cancelled (GCoroutine *co)
 {
-  g_return_val_if_fail (q != NULL, FALSE);
+  g_return_val_if_fail (co != NULL, FALSE);
 
-  return g_queue_is_empty (&q->queue);
+  return co->cancelled;
+}
+
+/**
+ * GCoValue:
+ * @v_pointer: a pointer value
+ * @v_size: an unsigned size value
+ * @v_ssize: a signed size value
+ * @v_int: an integer value
+ * @v_uint: an unsigned integer value
+ *
+ * A machine word exchanged between coroutines with
+ * g_coroutine_resume_values() and g_coroutine_yield_values().
+ */
+
+/**
+ * G_COROUTINE_MAX_VALUES:
+ *
+ * The maximum number of #GCoValue that can be exchanged at once with
+ * g_coroutine_resume_values() and g_coroutine_yield_values().
+ */
+
+/**
+ * g_coroutine_resume_values:
+ * @coroutine: a #GCoroutine
+ * @values: (array length=n_values): the values to supply to the coroutine
+ * @n_values: the number of @values, at most %G_COROUTINE_MAX_VALUES
+ *
+ * Like g_coroutine_resume(), but transfers up to
+ * %G_COROUTINE_MAX_VALUES words instead of a single pointer. The
+ * values are copied into @coroutine itself, so no allocation is needed
+ * to pass them.
+ *
+ * On the other side, the function of a coroutine entered for the first
+ * time receives a pointer to the values as @data, and
+ * g_coroutine_yield_values() returns it.
+ *
+ * Returns: the values yielded with g_coroutine_yield_values(), which
+ * remain valid until the current coroutine switches again, or %NULL
+ * if @coroutine terminated, in which case the return value of its
+ * function is dropped
+ **/
+const GCoValue *
+g_coroutine_resume_values (GCoroutine     *co,
+                           const GCoValue *values,
+                           guint           n_values)
+{
+  const GCoValue *ret;
+
+  g_return_val_if_fail (co != NULL, NULL);
+  g_return_val_if_fail (co->caller == NULL, NULL);
+  g_return_val_if_fail (n_values <= G_COROUTINE_MAX_VALUES, NULL);
+  g_return_val_if_fail (values != NULL || n_values == 0, NULL);
+
+  memcpy (co->values, values, n_values * sizeof (GCoValue));
+
+  /* the caller may not hold a reference to tell it terminated */
+  g_coroutine_ref (co);
+  ret = g_coroutine_resume (co, co->values);
+  if (co->terminated)
+    ret = NULL;
+  g_coroutine_unref (co);
+
+  return ret;
+}
+
+/**
+ * g_coroutine_yield_values:
+ * @values: (array length=n_values): the values to return to the caller
+ * @n_values: the number of @values, at most %G_COROUTINE_MAX_VALUES
+ *
+ * Like g_coroutine_yield(), but transfers up to
+ * %G_COROUTINE_MAX_VALUES words instead of a single pointer. The
+ * values are copied into the caller coroutine, so no allocation is
+ * needed to pass them.
+ *
+ * Returns: the values supplied by the caller in
+ * g_coroutine_resume_values(), which remain valid until the current
+ * coroutine switches again
+ **/
+const GCoValue *
+g_coroutine_yield_values (const GCoValue *values,
+                          guint           n_values) G_COROUTINE_FUNC
+{
+  GCoroutine *to = g_coroutine_self ()->caller;
+
+  g_return_val_if_fail (to != NULL, NULL);
+  g_return_val_if_fail (n_values <= G_COROUTINE_MAX_VALUES, NULL);
+  g_return_val_if_fail (values != NULL || n_values == 0, NULL);
+
+  memcpy (to->values, values, n_values * sizeof (GCoValue));
+  return g_coroutine_yield (to->values);
+}
+
+/**
+ * g_coroutine_alloc:
+ * @n_bytes: the number of bytes to allocate
+ *
+ * Allocates @n_bytes bytes of memory owned by the current coroutine.
+ *
+ * The memory is carved out of larger chunks attached to the coroutine,
+ * which makes allocating many small blocks cheap. It cannot be freed
+ * individually: all of it is released at once when the coroutine
+ * function returns, or when the coroutine is freed before, so it must
+ * not be referenced past that point.
+ *
+ * Returns: a pointer to the allocated memory, or %NULL if @n_bytes is 0
+ **/
+gpointer
+g_coroutine_alloc (gsize n_bytes) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GCoArenaChunk *chunk = self->arena;
+  gpointer mem;
+
+  g_return_val_if_fail (g_in_coroutine (), NULL);
+
+  if (n_bytes == 0)
+    return NULL;
+
+  n_bytes = CO_ARENA_ALIGN (n_bytes);
+
+  if (chunk == NULL || chunk->size - chunk->used < n_bytes)
+    {
+      if (n_bytes > CO_ARENA_CHUNK_SIZE / 4)
+        {
+          /* give big blocks their own chunk, behind the current one */
+          chunk = g_malloc (CO_ARENA_HEADER + n_bytes);
+          chunk->size = chunk->used = n_bytes;
+          if (self->arena)
+            {
+              chunk->next = self->arena->next;
+              self->arena->next = chunk;
+            }
+          else
+            {
+              chunk->next = NULL;
+              self->arena = chunk;
+            }
+
+          return (guint8 *)chunk + CO_ARENA_HEADER;
+        }
+
+      chunk = g_malloc (CO_ARENA_HEADER + CO_ARENA_CHUNK_SIZE);
+      chunk->size = CO_ARENA_CHUNK_SIZE;
+      chunk->used = 0;
+      chunk->next = self->arena;
+      self->arena = chunk;
+    }
+
+  mem = (guint8 *)chunk + CO_ARENA_HEADER + chunk->used;
+  chunk->used += n_bytes;
+
+  return mem;
+}
+
+/**
+ * g_coroutine_alloc0:
+ * @n_bytes: the number of bytes to allocate
+ *
+ * Like g_coroutine_alloc(), but initializes the memory to 0.
+ *
+ * Returns: a pointer to the allocated memory, or %NULL if @n_bytes is 0
+ **/
+gpointer
+g_coroutine_alloc0 (gsize n_bytes) G_COROUTINE_FUNC
+{
+  gpointer mem = g_coroutine_alloc (n_bytes);
+
+  if (mem)
+    memset (mem, 0, n_bytes);
+
+  return mem;
+}
+
+/**
+ * g_coroutine_self:
+ *
+ * This functions returns the #GCoroutine corresponding to the current
+ * coroutine. Note that this function does not increase the reference
+ * count of the returned struct.
+ *
+ * Returns: the #GCoroutine representing the current coroutine
+ **/
+GCoroutine *
+g_coroutine_self (void) G_COROUTINE_FUNC
+{
+  return _g_coroutine_self ();
+}
+
+/**
+ * g_in_coroutine:
+ *
+ * This function returns %TRUE if the current context of execution is
+ * from a coroutine.
+ *
+ * Returns: %TRUE if called from a coroutine context
+ **/
+gboolean
+g_in_coroutine (void)
+{
+  return _g_in_coroutine ();
+}
+
+/**
+ * GCoPrivate:
+ *
+ * The #GCoPrivate struct is an opaque data structure to represent a
+ * coroutine-local data key. It is similar to #GPrivate applied to
+ * coroutines: each coroutine has its own value for the key, which
+ * follows it across switches.
+ *
+ * The value is stored in a slot of the coroutine itself, so looking it
+ * up does not involve any hashing. The number of keys is limited to a
+ * small fixed amount, so keys should be static.
+ *
+ * When a coroutine function returns, or when a coroutine released
+ * while suspended is freed, the destroy notifier of the key is called
+ * on the value, if it is not %NULL.
+ */
+
+/**
+ * G_CO_PRIVATE_INIT:
+ * @notify: a #GDestroyNotify
+ *
+ * A macro to assist with the static initialisation of a #GCoPrivate.
+ *
+ * |[<!-- language="C" -->
+ *   static GCoPrivate request_id_key = G_CO_PRIVATE_INIT (g_free);
+ * ]|
+ */
+
+static guint
+co_private_index (GCoPrivate *key)
+{
+  guint index = g_atomic_int_get (&key->index);
+
+  if (G_LIKELY (index != 0))
+    return index - 1;
+
+  g_mutex_lock (&co_private_lock);
+  index = key->index;
+  if (index == 0)
+    {
+      if (co_private_n == G_CO_PRIVATE_MAX)
+        g_error ("Too many GCoPrivate keys (%d)", G_CO_PRIVATE_MAX);
+
+      co_private_notify[co_private_n] = key->notify;
+      index = co_private_n + 1;
+      g_atomic_int_set (&co_private_n, index);
+      g_atomic_int_set (&key->index, index);
+    }
+  g_mutex_unlock (&co_private_lock);
+
+  return index - 1;
+}
+
+/**
+ * g_co_private_get:
+ * @key: a #GCoPrivate
+ *
+ * Returns the current value of the coroutine-local variable @key for
+ * the current coroutine.
+ *
+ * If the value has not yet been set in this coroutine, %NULL is
+ * returned.
+ *
+ * Returns: the coroutine-local value
+ **/
+gpointer
+g_co_private_get (GCoPrivate *key)
+{
+  g_return_val_if_fail (key != NULL, NULL);
+
+  return g_coroutine_self ()->privates[co_private_index (key)];
+}
+
+/**
+ * g_co_private_set:
+ * @key: a #GCoPrivate
+ * @value: the new value
+ *
+ * Sets the coroutine-local variable @key to have the value @value in
+ * the current coroutine.
+ *
+ * This function differs from g_co_private_replace() in that the
+ * #GDestroyNotify for @key is not called on the old value.
+ **/
+void
+g_co_private_set (GCoPrivate *key,
+                  gpointer    value)
+{
+  g_return_if_fail (key != NULL);
+
+  g_coroutine_self ()->privates[co_private_index (key)] = value;
+}
+
+/**
+ * g_co_private_replace:
+ * @key: a #GCoPrivate
+ * @value: the new value
+ *
+ * Sets the coroutine-local variable @key to have the value @value in
+ * the current coroutine.
+ *
+ * This function differs from g_co_private_set() in the following way:
+ * if the previous value was non-%NULL then the #GDestroyNotify handler
+ * for @key is run on it.
+ **/
+void
+g_co_private_replace (GCoPrivate *key,
+                      gpointer    value)
+{
+  gpointer *slot;
+  gpointer old;
+
+  g_return_if_fail (key != NULL);
+
+  slot = &g_coroutine_self ()->privates[co_private_index (key)];
+  old = *slot;
+  *slot = value;
+
+  if (old && key->notify)
+    key->notify (old);
+}
+
+/**
+ * GCoQueue:
+ *
+ * The #GCoQueue struct is an opaque data structure to queue
+ * coroutines. It provides the fundamental primitives on which
+ * coroutine locks are built.
+ *
+ * The links of a blocked coroutine are kept on its own stack, so
+ * waiting on a #GCoQueue does not allocate memory, and a coroutine
+ * blocked on several queues with g_co_queue_select() can be removed
+ * from all of them in constant time.
+ */
+
+/* Detaches @co from all the queues it is blocked on, but the one at
+ * @index, which already popped it */
+static void
+co_wait_done (GCoroutine *co,
+              gint        index)
+{
+  guint i;
+
+  for (i = 0; i < co->n_waits; i++)
+    if ((gint)i != index)
+      g_queue_unlink (&co->wait_queues[i]->queue, &co->wait_links[i]);
+
+  co->wait_queues = NULL;
+  co->wait_links = NULL;
+  co->n_waits = 0;
+  co->wait_index = index;
+  co->cancellable = FALSE;
+}
+
+/* Queues the @link of a coroutine after the ones of the same or a
+ * higher priority, unless they were passed over too many times */
+static void
+co_queue_push_link (GQueue *queue,
+                    GList  *link)
+{
+  GCoroutine *co = link->data;
+  guint n = queue->length;
+  GList *l;
+
+  for (l = queue->tail; l; l = l->prev, n--)
+    {
+      GCoroutine *other = l->data;
+
+      if (other->priority <= co->priority ||
+          other->bypassed >= G_CO_PRIORITY_AGING)
+        break;
+    }
+
+  for (l = l ? l->next : queue->head; l; l = l->next)
+    ((GCoroutine *)l->data)->bypassed++;
+
+  g_queue_push_nth_link (queue, n, link);
+}
+
+static GCoroutine *
+co_queue_pop (GCoQueue *q)
+{
+  GList *link = g_queue_pop_head_link (&q->queue);
+  GCoroutine *co;
+
+  if (link == NULL)
+    return NULL;
+
+  co = link->data;
+  co_wait_done (co, link - co->wait_links);
+
+  return co;
+}
+
+typedef struct {
+  GSource     source;
+  GCoroutine *co;
+  gboolean    expired;
+} CoTimeoutSource;
+
+static gboolean
+co_timeout_dispatch (GSource     *source,
+                     GSourceFunc  callback,
+                     gpointer     user_data)
+{
+  CoTimeoutSource *timeout = (CoTimeoutSource *)source;
+  GCoroutine *co = timeout->co;
+
+  /* unless it was scheduled meanwhile, and is about to resume */
+  if (co->n_waits > 0)
+    {
+      timeout->expired = TRUE;
+      co_wait_done (co, -1);
+      g_coroutine_resume (co, NULL);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static GSourceFuncs co_timeout_funcs = {
+  NULL,
+  NULL,
+  co_timeout_dispatch,
+  NULL
+};
+
+/* Blocks the current coroutine on all of @queues until one of them
+ * schedules it, and stores its index in @index, or -1 if the
+ * coroutine was resumed by other means. Unless @end_time is -1, a
+ * timer on the thread-default main context resumes the coroutine
+ * at @end_time, and %FALSE is returned. %FALSE is also returned
+ * right away once the coroutine is cancelled. @data is the value
+ * yielded, replaced by the value the coroutine is resumed with. */
+static gboolean
+co_queue_wait (GCoQueue **queues,
+               guint      n,
+               gint64     end_time,
+               gpointer  *data,
+               gint      *index) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GList *links = g_newa (GList, n);
+  CoTimeoutSource *timeout = NULL;
+  gboolean expired = FALSE;
+  guint i;
+
+  if (self->cancelled)
+    {
+      if (index != NULL)
+        *index = -1;
+      *data = NULL;
+      return FALSE;
+    }
+
+  self->bypassed = 0;
+  for (i = 0; i < n; i++)
+    {
+      links[i].data = self;
+      links[i].next = links[i].prev = NULL;
+      co_queue_push_link (&queues[i]->queue, &links[i]);
+    }
+
+  self->wait_queues = queues;
+  self->wait_links = links;
+  self->n_waits = n;
+
+  if (end_time != -1)
+    {
+      timeout = (CoTimeoutSource *)g_source_new (&co_timeout_funcs,
+                                                 sizeof (CoTimeoutSource));
+      timeout->co = self;
+      g_source_set_ready_time (&timeout->source, end_time);
+      g_source_attach (&timeout->source,
+                       g_main_context_get_thread_default ());
+    }
+
+  self->cancellable = TRUE;
+  *data = g_coroutine_yield (*data);
+
+  if (self->n_waits > 0)
+    co_wait_done (self, -1);
+
+  if (index != NULL)
+    *index = self->wait_index;
+
+  if (timeout != NULL)
+    {
+      expired = timeout->expired;
+      g_source_destroy (&timeout->source);
+      g_source_unref (&timeout->source);
+    }
+
+  return !expired && !(self->cancelled && self->wait_index == -1);
+}
+
+/* g_co_queue_yield (queue, NULL), giving up at @end_time */
+static gboolean
+co_queue_yield_until (GCoQueue *q,
+                      gint64    end_time) G_COROUTINE_FUNC
+{
+  gpointer data = NULL;
+  gboolean ret;
+
+  ret = co_queue_wait (&q, 1, end_time, &data, NULL);
+  g_warn_if_fail (data == NULL);
+
+  return ret;
+}
+
+/**
+ * g_co_queue_init:
+ * @queue: a #GCoQueue
+ *
+ * Initializes a #GCoQueue so that it can be used.
+ **/
+void
+g_co_queue_init (GCoQueue *q)
+{
+  g_return_if_fail (q != NULL);
+
+  g_queue_init (&q->queue);
+}
+
+/**
+ * g_co_queue_yield:
+ * @queue: a #GCoQueue
+ * @data: an argument to return to the caller context
+ *
+ * Yields control back to the caller of g_coroutine_resume().
+ *
+ * Returns: the argument supplied by the caller in
+ * g_coroutine_resume()
+ **/
+gpointer
+g_co_queue_yield (GCoQueue *q, gpointer data) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (q != NULL, NULL);
+  g_return_val_if_fail (g_in_coroutine (), NULL);
+
+  co_queue_wait (&q, 1, -1, &data, NULL);
+
+  return data;
+}
+
+/**
+ * g_co_queue_yield_timed:
+ * @queue: a #GCoQueue
+ * @data: an argument to return to the caller context
+ * @end_time: the monotonic time to wait until
+ *
+ * Like g_co_queue_yield(), but gives up waiting at @end_time, as
+ * returned by g_get_monotonic_time().
+ *
+ * The timeout is dispatched by the thread-default #GMainContext,
+ * which removes the current coroutine from @queue and resumes it.
+ * The context must therefore be iterated while the coroutine waits.
+ *
+ * Returns: %FALSE if @end_time passed before the coroutine was
+ * scheduled, or if it was cancelled
+ **/
+gboolean
+g_co_queue_yield_timed (GCoQueue *q,
+                        gpointer  data,
+                        gint64    end_time) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (q != NULL, FALSE);
+  g_return_val_if_fail (g_in_coroutine (), FALSE);
+
+  return co_queue_wait (&q, 1, end_time, &data, NULL);
+}
+
+/**
+ * g_co_queue_select:
+ * @queues: (array length=n_queues): an array of #GCoQueue
+ * @n_queues: the number of queues in @queues
+ * @data: an argument to return to the caller context
+ *
+ * Queues the current coroutine on all of @queues at once, and yields
+ * control back to the caller of g_coroutine_resume(), like
+ * g_co_queue_yield(). The coroutine is scheduled by whichever queue
+ * pops it first, and is then removed from all the other queues.
+ *
+ * Returns: the index in @queues of the queue that scheduled the
+ * current coroutine, or -1 if it was resumed by other means
+ **/
+gint
+g_co_queue_select (GCoQueue **queues,
+                   guint      n_queues,
+                   gpointer   data) G_COROUTINE_FUNC
+{
+  gint index;
+
+  g_return_val_if_fail (queues != NULL, -1);
+  g_return_val_if_fail (n_queues > 0, -1);
+  g_return_val_if_fail (g_in_coroutine (), -1);
+
+  co_queue_wait (queues, n_queues, -1, &data, &index);
+
+  return index;
+}
+
+/**
+ * g_co_queue_schedule:
+ * @queue: a #GCoQueue
+ * @n: number of coroutines to schedule
+ *
+ * Pop @n coroutines from the @queue and schedule them for execution.
+ *
+ * Returns: the number of coroutines scheduled
+ **/
+gint
+g_co_queue_schedule (GCoQueue *q, gint n) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  gint i;
+
+  g_return_val_if_fail (q != NULL, -1);
+  g_return_val_if_fail (n >= -1, -1);
+
+  for (i = 0; (n == -1 || i < n) && !g_queue_is_empty (&q->queue); i++)
+    {
+      g_queue_push_tail (&self->resume_queue, co_queue_pop (q));
+    }
+
+  return i;
+}
+
+/**
+ * g_co_queue_resume_head:
+ * @queue: a #GCoQueue
+ * @data: an argument to return to the caller context
+ *
+ * Resume the first coroutine from the @queue.
+ *
+ * Returns: the argument returned by the head coroutine
+ **/
+gpointer
+g_co_queue_resume_head (GCoQueue *q, gpointer data)
+{
+  GCoroutine *co;
+
+  g_return_val_if_fail (q != NULL, NULL);
+  g_return_val_if_fail (!g_queue_is_empty (&q->queue), NULL);
+
+  co = co_queue_pop (q);
+  g_return_val_if_fail (co != NULL, NULL);
+
+  return g_coroutine_resume (co, data);
+}
+
+/**
+ * g_co_queue_is_empty:
+ * @queue: a #GCoQueue
+ *
+ * Returns %TRUE if the queue is empty.
+ *
+ * Returns: %TRUE if the queue is empty
+ **/
+gboolean
+g_co_queue_is_empty (GCoQueue *q)
+{
+  g_return_val_if_fail (q != NULL, FALSE);
+
+  return g_queue_is_empty (&q->queue);
 }
 
 /**
  * GCoMutex:
  *
- * The #GCoMutex struct is an opaque data structure to represent a
- * mutex (mutual exclusion).  It can be used to protect data against
- * shared access. It is similar to #GMutex applied to coroutines.
-*/
+ * The #GCoMutex struct is an opaque data structure to represent a
+ * mutex (mutual exclusion).  It can be used to protect data against
+ * shared access. It is similar to #GMutex applied to coroutines.
+*/
+
+/**
+ * g_co_mutex_init:
+ * @mutex: a #GCoMutex
+ *
+ * Initializes a #GCoMutex so that it can be used.
+ **/
+void
+g_co_mutex_init (GCoMutex *mutex)
+{
+  g_co_mutex_init_full (mutex, G_CO_MUTEX_DEFAULT);
+}
+
+/**
+ * GCoMutexFlags:
+ * @G_CO_MUTEX_DEFAULT: when unlocked, the mutex is free to be taken by
+ *     any coroutine, including the one that just released it
+ * @G_CO_MUTEX_FAIR: when unlocked, the ownership of the mutex is handed
+ *     over directly to the first waiting coroutine, in FIFO order
+ * @G_CO_MUTEX_THREAD_SAFE: the mutex can be shared by coroutines
+ *     running in different threads, see g_co_mutex_init_full()
+ *
+ * Flags to change the behaviour of a #GCoMutex.
+ */
+
+/**
+ * g_co_mutex_init_full:
+ * @mutex: a #GCoMutex
+ * @flags: a set of #GCoMutexFlags
+ *
+ * Initializes a #GCoMutex so that it can be used, with the behaviour
+ * specified by @flags.
+ *
+ * A %G_CO_MUTEX_FAIR mutex grants the lock in FIFO order. A waiting
+ * coroutine is not woken up only to find the lock taken again, so the
+ * time spent waiting is bounded by the number of waiters ahead of it.
+ *
+ * A %G_CO_MUTEX_THREAD_SAFE mutex is locked and unlocked with a single
+ * atomic operation when it is not contended. Otherwise the coroutine
+ * locking it is parked, without ever blocking its thread, and the lock
+ * is handed over to it when unlocked, as with %G_CO_MUTEX_FAIR: the
+ * coroutine is then resumed by its home thread, with
+ * g_coroutine_wakeup(), so that thread must run its main context. A
+ * coroutine run by a #GCoPool is instead queued again on a worker of
+ * its pool. It can't be used with g_co_mutex_lock_timed() or
+ * g_co_cond_wait().
+ **/
+void
+g_co_mutex_init_full (GCoMutex      *mutex,
+                      GCoMutexFlags  flags)
+{
+  g_return_if_fail (mutex != NULL);
+
+  memset (mutex, 0, sizeof(*mutex));
+  g_co_queue_init (&mutex->queue);
+  mutex->locked = FALSE;
+  mutex->flags = flags;
+}
+
+/* G_CO_MUTEX_THREAD_SAFE values of mutex->locked */
+enum {
+  CO_MUTEX_UNLOCKED,
+  CO_MUTEX_LOCKED,
+  CO_MUTEX_CONTENDED,           /* coroutines are parked in the queue */
+};
+
+static void
+co_mutex_lock_shared (GCoMutex *mutex) G_COROUTINE_FUNC
+{
+  GList link = { NULL, };
+  gpointer data;
+
+  if (g_atomic_int_compare_and_exchange (&mutex->locked,
+                                         CO_MUTEX_UNLOCKED, CO_MUTEX_LOCKED))
+    return;
+
+  /* the queue and the contended state only change with wait_lock */
+  g_bit_lock (&mutex->wait_lock, 0);
+  while (!g_atomic_int_compare_and_exchange (&mutex->locked,
+                                             CO_MUTEX_LOCKED, CO_MUTEX_CONTENDED) &&
+         g_atomic_int_get (&mutex->locked) != CO_MUTEX_CONTENDED)
+    {
+      if (g_atomic_int_compare_and_exchange (&mutex->locked,
+                                             CO_MUTEX_UNLOCKED, CO_MUTEX_LOCKED))
+        {
+          g_bit_unlock (&mutex->wait_lock, 0);
+          return;
+        }
+    }
+
+  link.data = g_coroutine_self ();
+  ((GCoroutine *)link.data)->bypassed = 0;
+  _g_co_pool_park ();
+  co_queue_push_link (&mutex->queue.queue, &link);
+  g_bit_unlock (&mutex->wait_lock, 0);
+
+  /* the lock is handed over by g_co_mutex_unlock() */
+  data = g_coroutine_yield (NULL);
+  g_warn_if_fail (data == NULL);
+}
+
+static void
+co_mutex_unlock_shared (GCoMutex *mutex)
+{
+  GCoroutine *co;
+  GList *link;
+
+  if (g_atomic_int_compare_and_exchange (&mutex->locked,
+                                         CO_MUTEX_LOCKED, CO_MUTEX_UNLOCKED))
+    return;
+
+  /* keep it locked on behalf of the head waiter */
+  g_bit_lock (&mutex->wait_lock, 0);
+  link = g_queue_pop_head_link (&mutex->queue.queue);
+  co = link->data;
+  g_atomic_int_set (&mutex->locked,
+                    g_queue_is_empty (&mutex->queue.queue) ?
+                    CO_MUTEX_LOCKED : CO_MUTEX_CONTENDED);
+  g_bit_unlock (&mutex->wait_lock, 0);
+
+  /* a coroutine of a pool goes back to a worker */
+  if (g_atomic_int_get (&co->park) != CO_PARK_NONE)
+    _g_co_pool_wakeup (co);
+  else
+    g_coroutine_wakeup (co);
+}
+
+static gboolean
+co_mutex_lock (GCoMutex *mutex,
+               gint64    end_time) G_COROUTINE_FUNC
+{
+  if (mutex->flags & G_CO_MUTEX_THREAD_SAFE)
+    {
+      co_mutex_lock_shared (mutex);
+      return TRUE;
+    }
+
+  if (mutex->flags & G_CO_MUTEX_FAIR)
+    {
+      GCoroutine *self = g_coroutine_self ();
+
+      /* the lock is handed over by g_co_mutex_unlock(), anything else
+       * resuming the coroutine has it wait again */
+      while (mutex->locked && mutex->handoff != self)
+        {
+          if (co_queue_yield_until (&mutex->queue, end_time))
+            continue;
+
+          /* pass on a lock handed over as the wait was given up */
+          if (mutex->handoff == self)
+            {
+              mutex->handoff = NULL;
+              g_co_mutex_unlock (mutex);
+            }
+          return FALSE;
+        }
+
+      mutex->handoff = NULL;
+      mutex->locked = TRUE;
+      return TRUE;
+    }
+
+  while (mutex->locked)
+    {
+      if (!co_queue_yield_until (&mutex->queue, end_time))
+        return FALSE;
+    }
+
+  mutex->locked = TRUE;
+  return TRUE;
+}
+
+/**
+ * g_co_mutex_lock:
+ * @mutex: a #GCoMutex
+ *
+ * Locks @mutex. If @mutex is already locked by another coroutine, the
+ * current coroutine will yield %NULL to the caller coroutine until
+ * @mutex is unlocked by the other coroutine.
+ *
+ * Returns: %TRUE if @mutex is now locked by the current coroutine,
+ * %FALSE if it was cancelled, see g_coroutine_cancel()
+ **/
+gboolean
+g_co_mutex_lock (GCoMutex *mutex) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (mutex != NULL, FALSE);
+
+  return co_mutex_lock (mutex, -1);
+}
+
+/**
+ * g_co_mutex_lock_timed:
+ * @mutex: a #GCoMutex
+ * @end_time: the monotonic time to wait until
+ *
+ * Like g_co_mutex_lock(), but gives up waiting for @mutex at
+ * @end_time, as returned by g_get_monotonic_time(). See
+ * g_co_queue_yield_timed().
+ *
+ * Returns: %TRUE if @mutex is now locked by the current coroutine,
+ * %FALSE if @end_time passed before, or if it was cancelled
+ **/
+gboolean
+g_co_mutex_lock_timed (GCoMutex *mutex,
+                       gint64    end_time) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (mutex != NULL, FALSE);
+  g_return_val_if_fail (!(mutex->flags & G_CO_MUTEX_THREAD_SAFE), FALSE);
+
+  return co_mutex_lock (mutex, end_time);
+}
+
+/**
+ * g_co_mutex_unlock:
+ * @mutex: a #GCoMutex
+ *
+ * Unlocks @mutex. If another coroutine is blocking in a
+ * g_co_mutex_lock() call for @mutex, it will become unblocked and can
+ * lock @mutex itself. With %G_CO_MUTEX_FAIR, it owns @mutex as soon as
+ * it is unblocked.
+ *
+ **/
+void
+g_co_mutex_unlock (GCoMutex *mutex) G_COROUTINE_FUNC
+{
+  g_return_if_fail (mutex != NULL);
+  g_return_if_fail (mutex->locked);
+
+  if (mutex->flags & G_CO_MUTEX_THREAD_SAFE)
+    {
+      co_mutex_unlock_shared (mutex);
+      return;
+    }
+
+  if ((mutex->flags & G_CO_MUTEX_FAIR) &&
+      !g_co_queue_is_empty (&mutex->queue))
+    {
+      /* keep it locked on behalf of the head waiter */
+      mutex->handoff = g_queue_peek_head (&mutex->queue.queue);
+      g_co_queue_schedule (&mutex->queue, 1);
+      return;
+    }
+
+  mutex->locked = FALSE;
+  g_co_queue_schedule (&mutex->queue, 1);
+}
+
+/**
+ * GCoCond:
+ *
+ * The #GCoCond struct is an opaque data structure that represents a
+ * condition. It is similar to #GCond applied to coroutines: a
+ * coroutine can block on a #GCoCond until another coroutine signals
+ * it, always in combination with a #GCoMutex protecting the shared
+ * state.
+ *
+ * Coroutines woken up while the mutex is held are moved to the mutex
+ * wait queue instead of being scheduled, so that a broadcast does not
+ * resume many coroutines only to have them block on the mutex again.
+ */
 
 /**
- * g_co_mutex_init:
- * @mutex: a #GCoMutex
+ * g_co_cond_init:
+ * @cond: a #GCoCond
  *
- * Initializes a #GCoMutex so that it can be used.
+ * Initializes a #GCoCond so that it can be used.
  **/
 void
-g_co_mutex_init (GCoMutex *mutex)
+g_co_cond_init (GCoCond *cond)
 {
-  g_return_if_fail (mutex != NULL);
+  g_return_if_fail (cond != NULL);
 
-  memset (mutex, 0, sizeof(*mutex));
-  mutex->locked = FALSE;
+  memset (cond, 0, sizeof(*cond));
+  g_co_queue_init (&cond->queue);
 }
 
 /**
- * g_co_mutex_lock:
- * @mutex: a #GCoMutex
+ * g_co_cond_wait:
+ * @cond: a #GCoCond
+ * @mutex: the #GCoMutex that is currently locked
  *
- * Locks @mutex. If @mutex is already locked by another coroutine, the
- * current coroutine will yield %NULL to the caller coroutine until
- * @mutex is unlocked by the other coroutine.
+ * Atomically releases @mutex and waits until @cond is signalled. When
+ * this function returns, @mutex is locked again and owned by the
+ * calling coroutine.
+ *
+ * All the coroutines waiting on @cond at the same time must use the
+ * same @mutex.
+ *
+ * As with #GCond, the condition should be checked again in a loop
+ * after this function returns, since another coroutine may have
+ * changed the shared state in the meantime.
+ *
+ * If the current coroutine is cancelled, it stops waiting for @cond,
+ * but still waits to lock @mutex again.
+ *
+ * Returns: %FALSE if the current coroutine was cancelled, see
+ * g_coroutine_cancel()
+ **/
+gboolean
+g_co_cond_wait (GCoCond  *cond,
+                GCoMutex *mutex) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GCoQueue *queue = &cond->queue;
+  gpointer data = NULL;
+  gboolean cancelled;
+
+  g_return_val_if_fail (cond != NULL, FALSE);
+  g_return_val_if_fail (mutex != NULL && mutex->locked, FALSE);
+  g_return_val_if_fail (!(mutex->flags & G_CO_MUTEX_THREAD_SAFE), FALSE);
+  g_return_val_if_fail (cond->mutex == NULL || cond->mutex == mutex, FALSE);
+
+  if (self->cancelled)
+    return FALSE;
+
+  cond->mutex = mutex;
+  g_co_mutex_unlock (mutex);
+
+  /* co_cond_wake() may move it to the mutex queue meanwhile */
+  co_queue_wait (&queue, 1, -1, &data, NULL);
+  g_warn_if_fail (data == NULL);
+
+  if ((mutex->flags & G_CO_MUTEX_FAIR) && mutex->handoff == self)
+    {
+      /* moved to the mutex queue and handed the lock by unlock */
+      mutex->handoff = NULL;
+      return TRUE;
+    }
+
+  /* the mutex must be locked again, even once cancelled */
+  cancelled = self->cancelled;
+  self->cancelled = FALSE;
+  while (!co_mutex_lock (mutex, -1))
+    {
+      cancelled = TRUE;
+      self->cancelled = FALSE;
+    }
+  self->cancelled = cancelled;
+
+  return !cancelled;
+}
+
+static void
+co_cond_wake (GCoCond *cond,
+              gint     n) G_COROUTINE_FUNC
+{
+  GCoMutex *mutex = cond->mutex;
+  gint i;
+
+  if (mutex == NULL)
+    return;
+
+  if (!mutex->locked)
+    {
+      /* let the first one take the lock, it will wake the next ones
+       * moved to the mutex queue when unlocking */
+      g_co_queue_schedule (&cond->queue, 1);
+      n = n == -1 ? n : n - 1;
+    }
+
+  for (i = 0; (n == -1 || i < n) && !g_co_queue_is_empty (&cond->queue); i++)
+    {
+      GList *link = g_queue_pop_head_link (&cond->queue.queue);
+      GCoroutine *co = link->data;
+
+      co->wait_queues[link - co->wait_links] = &mutex->queue;
+      co_queue_push_link (&mutex->queue.queue, link);
+    }
+
+  if (g_co_queue_is_empty (&cond->queue))
+    cond->mutex = NULL;
+}
+
+/**
+ * g_co_cond_signal:
+ * @cond: a #GCoCond
  *
+ * If coroutines are waiting for @cond, the first one of them is woken
+ * up. It will resume once it can lock the mutex again.
  **/
 void
-g_co_mutex_lock (GCoMutex *mutex) G_COROUTINE_FUNC
+g_co_cond_signal (GCoCond *cond) G_COROUTINE_FUNC
 {
-  g_return_if_fail (mutex != NULL);
+  g_return_if_fail (cond != NULL);
 
-  while (mutex->locked)
+  co_cond_wake (cond, 1);
+}
+
+/**
+ * g_co_cond_broadcast:
+ * @cond: a #GCoCond
+ *
+ * If coroutines are waiting for @cond, all of them are woken up. They
+ * will resume one at a time, as they lock the mutex again.
+ **/
+void
+g_co_cond_broadcast (GCoCond *cond) G_COROUTINE_FUNC
+{
+  g_return_if_fail (cond != NULL);
+
+  co_cond_wake (cond, -1);
+}
+
+/**
+ * GCoSemaphore:
+ *
+ * The #GCoSemaphore struct is an opaque data structure to represent a
+ * counting semaphore. It holds a number of permits that coroutines
+ * acquire and release, and can be used to bound the number of
+ * coroutines concurrently accessing a resource.
+ *
+ * Waiting coroutines are served in FIFO order: a coroutine asking for
+ * more permits than available blocks the ones queued after it, even if
+ * they ask for fewer.
+ */
+
+/**
+ * g_co_semaphore_init:
+ * @sem: a #GCoSemaphore
+ * @value: the initial number of permits
+ *
+ * Initializes a #GCoSemaphore so that it can be used.
+ **/
+void
+g_co_semaphore_init (GCoSemaphore *sem,
+                     guint         value)
+{
+  g_return_if_fail (sem != NULL);
+
+  memset (sem, 0, sizeof(*sem));
+  g_co_queue_init (&sem->queue);
+  sem->value = value;
+}
+
+/* Schedules the waiters in FIFO order, as long as there are enough
+ * permits for them */
+static void
+co_semaphore_grant (GCoSemaphore *sem) G_COROUTINE_FUNC
+{
+  GCoroutine *head;
+
+  while ((head = g_queue_peek_head (&sem->queue.queue)) != NULL &&
+         GPOINTER_TO_UINT (head->wait_data) <= sem->value)
     {
-      gpointer data = g_co_queue_yield (&mutex->queue, NULL);
-      g_warn_if_fail (data == NULL);
+      sem->value -= GPOINTER_TO_UINT (head->wait_data);
+      head->wait_data = NULL;
+      g_co_queue_schedule (&sem->queue, 1);
     }
+}
 
-  mutex->locked = TRUE;
+/**
+ * g_co_semaphore_acquire:
+ * @sem: a #GCoSemaphore
+ * @n: the number of permits to acquire
+ *
+ * Acquires @n permits from @sem. If not enough permits are available,
+ * or if other coroutines are already waiting, the current coroutine
+ * will yield %NULL to its caller until @n permits are released for
+ * it.
+ *
+ * Returns: %TRUE if the permits were acquired, %FALSE if the current
+ * coroutine was cancelled, see g_coroutine_cancel()
+ **/
+gboolean
+g_co_semaphore_acquire (GCoSemaphore *sem,
+                        guint         n) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+
+  g_return_val_if_fail (sem != NULL, FALSE);
+
+  if (g_co_queue_is_empty (&sem->queue) && sem->value >= n)
+    {
+      sem->value -= n;
+      return TRUE;
+    }
+
+  /* the permits are granted by co_semaphore_grant(), which clears
+   * wait_data, anything else resuming the coroutine has it wait again */
+  self->wait_data = GUINT_TO_POINTER (n);
+  while (self->wait_data != NULL)
+    {
+      if (co_queue_yield_until (&sem->queue, -1))
+        {
+          if (self->wait_data == NULL)
+            continue;
+
+          /* no longer queued, it may have been the one in the way */
+          co_semaphore_grant (sem);
+          if (g_co_queue_is_empty (&sem->queue) && sem->value >= n)
+            {
+              sem->value -= n;
+              self->wait_data = NULL;
+            }
+          continue;
+        }
+
+      /* the ones queued behind may fit now */
+      self->wait_data = NULL;
+      co_semaphore_grant (sem);
+      return FALSE;
+    }
+
+  return TRUE;
 }
 
 /**
- * g_co_mutex_unlock:
- * @mutex: a #GCoMutex
+ * g_co_semaphore_try_acquire:
+ * @sem: a #GCoSemaphore
+ * @n: the number of permits to acquire
  *
- * Unlocks @mutex. If another coroutine is blocking in a
- * g_co_mutex_lock() call for @mutex, it will become unblocked and can
- * lock @mutex itself.
+ * Tries to acquire @n permits from @sem, without ever yielding.
+ *
+ * Returns: %TRUE if the permits were acquired
+ **/
+gboolean
+g_co_semaphore_try_acquire (GCoSemaphore *sem,
+                            guint         n)
+{
+  g_return_val_if_fail (sem != NULL, FALSE);
+
+  if (!g_co_queue_is_empty (&sem->queue) || sem->value < n)
+    return FALSE;
+
+  sem->value -= n;
+  return TRUE;
+}
+
+/**
+ * g_co_semaphore_release:
+ * @sem: a #GCoSemaphore
+ * @n: the number of permits to release
  *
+ * Releases @n permits to @sem. Waiting coroutines are scheduled in
+ * FIFO order, only as long as there are enough permits for them.
  **/
 void
-g_co_mutex_unlock (GCoMutex *mutex) G_COROUTINE_FUNC
+g_co_semaphore_release (GCoSemaphore *sem,
+                        guint         n) G_COROUTINE_FUNC
 {
-  g_return_if_fail (mutex != NULL);
-  g_return_if_fail (mutex->locked);
+  g_return_if_fail (sem != NULL);
 
-  mutex->locked = FALSE;
-  g_co_queue_schedule (&mutex->queue, 1);
+  sem->value += n;
+  co_semaphore_grant (sem);
+}
+
+/**
+ * g_co_semaphore_get_value:
+ * @sem: a #GCoSemaphore
+ *
+ * Returns the number of permits currently available.
+ *
+ * Returns: the number of available permits
+ **/
+guint
+g_co_semaphore_get_value (GCoSemaphore *sem)
+{
+  g_return_val_if_fail (sem != NULL, 0);
+
+  return sem->value;
+}
+
+/**
+ * GCoWaitGroup:
+ *
+ * The #GCoWaitGroup struct is an opaque data structure to wait for a
+ * group of coroutines to finish. The counter of the group is
+ * incremented with g_co_wait_group_add() for each coroutine started,
+ * each of them calls g_co_wait_group_done() when it is finished, and
+ * g_co_wait_group_wait() blocks until the counter drops to zero.
+ */
+
+/**
+ * g_co_wait_group_init:
+ * @wg: a #GCoWaitGroup
+ *
+ * Initializes a #GCoWaitGroup with a counter of zero.
+ **/
+void
+g_co_wait_group_init (GCoWaitGroup *wg)
+{
+  g_return_if_fail (wg != NULL);
+
+  memset (wg, 0, sizeof(*wg));
+  g_co_queue_init (&wg->queue);
+}
+
+/**
+ * g_co_wait_group_add:
+ * @wg: a #GCoWaitGroup
+ * @delta: the value to add to the counter, which may be negative
+ *
+ * Adds @delta to the counter of @wg. If it drops to zero, all the
+ * coroutines waiting in g_co_wait_group_wait() are scheduled. The
+ * counter must never become negative.
+ **/
+void
+g_co_wait_group_add (GCoWaitGroup *wg,
+                     gint          delta) G_COROUTINE_FUNC
+{
+  g_return_if_fail (wg != NULL);
+  g_return_if_fail (wg->count + delta >= 0);
+
+  wg->count += delta;
+  if (wg->count == 0)
+    g_co_queue_schedule (&wg->queue, -1);
+}
+
+/**
+ * g_co_wait_group_done:
+ * @wg: a #GCoWaitGroup
+ *
+ * Decrements the counter of @wg by one.
+ **/
+void
+g_co_wait_group_done (GCoWaitGroup *wg) G_COROUTINE_FUNC
+{
+  g_co_wait_group_add (wg, -1);
+}
+
+/**
+ * g_co_wait_group_wait:
+ * @wg: a #GCoWaitGroup
+ *
+ * Waits until the counter of @wg is zero. If it is not already, the
+ * current coroutine will yield %NULL until it drops to zero.
+ *
+ * Returns: %FALSE if the current coroutine was cancelled before, see
+ * g_coroutine_cancel()
+ **/
+gboolean
+g_co_wait_group_wait (GCoWaitGroup *wg) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (wg != NULL, FALSE);
+
+  /* scheduled by g_co_wait_group_add(), anything else resuming the
+   * coroutine has it wait again */
+  while (wg->count > 0)
+    {
+      if (!co_queue_yield_until (&wg->queue, -1))
+        return FALSE;
+    }
+
+  return TRUE;
 }
 
 /**
@@ -476,19 +2126,130 @@ g_co_mutex_unlock (GCoMutex *mutex) G_COROUTINE_FUNC
  * holding the 'reader' lock via g_co_rw_lock_reader_lock()).
  */
 
+/**
+ * GCoRWLockPolicy:
+ * @G_CO_RW_LOCK_PREFER_READER: readers only wait while a writer holds
+ *     the lock, and a released write lock goes to the readers first.
+ *     Writers may starve under a steady stream of readers.
+ * @G_CO_RW_LOCK_PREFER_WRITER: readers wait while a writer is waiting,
+ *     and a released write lock goes to the next writer first
+ * @G_CO_RW_LOCK_PHASE_FAIR: readers wait while a writer is waiting,
+ *     and a released write lock goes to the readers that queued up
+ *     meanwhile, so that read and write phases alternate
+ *
+ * The policy used by a #GCoRWLock to arbitrate between readers and
+ * writers.
+ */
+
 /**
  * g_co_rw_lock_init:
  * @lock: a #GCoRWLock
  *
- * Initializes a #GCoRWLock so that it can be used.
+ * Initializes a #GCoRWLock so that it can be used, with the
+ * %G_CO_RW_LOCK_PREFER_READER policy, which lets read locks be taken
+ * recursively. Use g_co_rw_lock_init_full() to prefer writers.
  **/
 void
 g_co_rw_lock_init (GCoRWLock *lock)
+{
+  g_co_rw_lock_init_full (lock, G_CO_RW_LOCK_PREFER_READER);
+}
+
+/**
+ * g_co_rw_lock_init_full:
+ * @lock: a #GCoRWLock
+ * @policy: a #GCoRWLockPolicy
+ *
+ * Initializes a #GCoRWLock so that it can be used, with the given
+ * @policy.
+ **/
+void
+g_co_rw_lock_init_full (GCoRWLock       *lock,
+                        GCoRWLockPolicy  policy)
 {
   g_return_if_fail (lock != NULL);
 
   memset (lock, 0, sizeof(*lock));
-  g_co_queue_init (&lock->queue);
+  g_co_queue_init (&lock->readers);
+  g_co_queue_init (&lock->writers);
+  lock->policy = policy;
+}
+
+/* Schedules @n waiters of @queue, marking them as owning @lock */
+static gint
+co_rw_lock_schedule (GCoRWLock *lock,
+                     GCoQueue  *queue,
+                     gint       n) G_COROUTINE_FUNC
+{
+  GList *l;
+  gint i;
+
+  for (l = queue->queue.head, i = 0; l && (n == -1 || i < n); l = l->next, i++)
+    ((GCoroutine *)l->data)->wait_data = lock;
+
+  return g_co_queue_schedule (queue, n);
+}
+
+/* Hand the lock over to the waiters if it is free. Waiters own the
+ * lock as soon as they are scheduled and don't check it again. */
+static void
+co_rw_lock_grant (GCoRWLock *lock,
+                  gboolean   readers_first) G_COROUTINE_FUNC
+{
+  if (lock->writer || lock->reader > 0)
+    return;
+
+  if (g_co_queue_is_empty (&lock->writers) ||
+      (readers_first && !g_co_queue_is_empty (&lock->readers)))
+    {
+      lock->reader += co_rw_lock_schedule (lock, &lock->readers, -1);
+    }
+  else
+    {
+      lock->writer = TRUE;
+      co_rw_lock_schedule (lock, &lock->writers, 1);
+    }
+}
+
+/* Waits on @queue until co_rw_lock_grant() hands @lock over, and
+ * returns %TRUE then. Returns %FALSE if the wait was given up, and
+ * %TRUE with @granted unset if the coroutine was resumed by other
+ * means, in which case it must check the lock again. */
+static gboolean
+co_rw_lock_wait (GCoRWLock *lock,
+                 GCoQueue  *queue,
+                 gint64     end_time,
+                 gboolean  *granted) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  gboolean ret;
+
+  self->wait_data = NULL;
+  ret = co_queue_yield_until (queue, end_time);
+  *granted = self->wait_data == lock;
+  self->wait_data = NULL;
+
+  return ret || *granted;
+}
+
+static gboolean
+co_rw_lock_reader_lock (GCoRWLock *lock,
+                        gint64     end_time) G_COROUTINE_FUNC
+{
+  gboolean granted;
+
+  while (lock->writer ||
+         (lock->policy != G_CO_RW_LOCK_PREFER_READER &&
+          !g_co_queue_is_empty (&lock->writers)))
+    {
+      if (!co_rw_lock_wait (lock, &lock->readers, end_time, &granted))
+        return FALSE;
+      if (granted)
+        return TRUE;
+    }
+
+  lock->reader++;
+  return TRUE;
 }
 
 /**
@@ -496,22 +2257,44 @@ g_co_rw_lock_init (GCoRWLock *lock)
  * @lock: a #GCoRWLock
  *
  * Obtain a read lock on @lock. If another coroutine currently holds
- * the write lock on @lock or blocks waiting for it, the current
- * coroutine will yield %NULL to the caller of the current
- * coroutine. Read locks can be taken recursively.
+ * the write lock on @lock, or blocks waiting for it and the policy is
+ * not %G_CO_RW_LOCK_PREFER_READER, the current coroutine will yield
+ * %NULL to the caller of the current coroutine.
+ *
+ * Read locks can be taken recursively with the
+ * %G_CO_RW_LOCK_PREFER_READER policy of g_co_rw_lock_init(). With the
+ * other policies, a writer waiting between the two calls would cause
+ * a deadlock.
+ *
+ * Returns: %TRUE if the read lock was obtained, %FALSE if the current
+ * coroutine was cancelled, see g_coroutine_cancel()
  **/
-void
+gboolean
 g_co_rw_lock_reader_lock (GCoRWLock *lock) G_COROUTINE_FUNC
 {
-  g_return_if_fail (lock != NULL);
+  g_return_val_if_fail (lock != NULL, FALSE);
 
-  while (lock->writer)
-    {
-      gpointer data = g_co_queue_yield (&lock->queue, NULL);
-      g_warn_if_fail (data == NULL);
-    }
+  return co_rw_lock_reader_lock (lock, -1);
+}
 
-  lock->reader++;
+/**
+ * g_co_rw_lock_reader_lock_timed:
+ * @lock: a #GCoRWLock
+ * @end_time: the monotonic time to wait until
+ *
+ * Like g_co_rw_lock_reader_lock(), but gives up waiting at @end_time,
+ * as returned by g_get_monotonic_time(). See g_co_queue_yield_timed().
+ *
+ * Returns: %TRUE if the read lock was obtained, %FALSE if @end_time
+ * passed before, or if the current coroutine was cancelled
+ **/
+gboolean
+g_co_rw_lock_reader_lock_timed (GCoRWLock *lock,
+                                gint64     end_time) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (lock != NULL, FALSE);
+
+  return co_rw_lock_reader_lock (lock, end_time);
 }
 
 /**
@@ -527,9 +2310,33 @@ g_co_rw_lock_reader_unlock (GCoRWLock *lock) G_COROUTINE_FUNC
   g_return_if_fail (lock->reader > 0);
 
   lock->reader--;
-  /* wakeup only one waiting writer */
-  if (lock->reader == 0)
-    g_co_queue_schedule (&lock->queue, 1);
+  co_rw_lock_grant (lock, FALSE);
+}
+
+static gboolean
+co_rw_lock_writer_lock (GCoRWLock *lock,
+                        gint64     end_time) G_COROUTINE_FUNC
+{
+  gboolean granted;
+
+  while (lock->writer || lock->reader)
+    {
+      if (co_rw_lock_wait (lock, &lock->writers, end_time, &granted))
+        {
+          if (granted)
+            return TRUE;
+          continue;
+        }
+
+      /* readers may have queued only because this writer waited */
+      if (!lock->writer && g_co_queue_is_empty (&lock->writers))
+        lock->reader += co_rw_lock_schedule (lock, &lock->readers, -1);
+
+      return FALSE;
+    }
+
+  lock->writer = TRUE;
+  return TRUE;
 }
 
 /**
@@ -539,19 +2346,36 @@ g_co_rw_lock_reader_unlock (GCoRWLock *lock) G_COROUTINE_FUNC
  * Obtain a write lock. If any coroutine already holds a read or write
  * lock, the current coroutine will yield %NULL until all other
  * coroutines have dropped their locks.
+ *
+ * Returns: %TRUE if the write lock was obtained, %FALSE if the current
+ * coroutine was cancelled, see g_coroutine_cancel()
  **/
-void
+gboolean
 g_co_rw_lock_writer_lock (GCoRWLock *lock) G_COROUTINE_FUNC
 {
-  g_return_if_fail (lock != NULL);
+  g_return_val_if_fail (lock != NULL, FALSE);
 
-  while (lock->writer || lock->reader)
-    {
-      gpointer data = g_co_queue_yield (&lock->queue, NULL);
-      g_warn_if_fail (data == NULL);
-    }
+  return co_rw_lock_writer_lock (lock, -1);
+}
 
-  lock->writer = TRUE;
+/**
+ * g_co_rw_lock_writer_lock_timed:
+ * @lock: a #GCoRWLock
+ * @end_time: the monotonic time to wait until
+ *
+ * Like g_co_rw_lock_writer_lock(), but gives up waiting at @end_time,
+ * as returned by g_get_monotonic_time(). See g_co_queue_yield_timed().
+ *
+ * Returns: %TRUE if the write lock was obtained, %FALSE if @end_time
+ * passed before, or if the current coroutine was cancelled
+ **/
+gboolean
+g_co_rw_lock_writer_lock_timed (GCoRWLock *lock,
+                                gint64     end_time) G_COROUTINE_FUNC
+{
+  g_return_val_if_fail (lock != NULL, FALSE);
+
+  return co_rw_lock_writer_lock (lock, end_time);
 }
 
 /**
@@ -567,6 +2391,5 @@ g_co_rw_lock_writer_unlock (GCoRWLock *lock) G_COROUTINE_FUNC
   g_return_if_fail (lock->writer);
 
   lock->writer = FALSE;
-
-  g_co_queue_schedule (&lock->queue, -1);
+  co_rw_lock_grant (lock, lock->policy != G_CO_RW_LOCK_PREFER_WRITER);
 }
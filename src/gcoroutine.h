@@ -41,25 +41,106 @@ typedef struct _GCoroutine GCoroutine;
 
 typedef gpointer      (*GCoroutineFunc)      (gpointer data) G_COROUTINE_FUNC;
 
+#define G_COROUTINE_MAX_VALUES 4
+
+typedef union _GCoValue GCoValue;
+union _GCoValue {
+  gpointer v_pointer;
+  gsize    v_size;
+  gssize   v_ssize;
+  gint     v_int;
+  guint    v_uint;
+};
+
+typedef struct _GCoroutineStorage GCoroutineStorage;
+struct _GCoroutineStorage {
+  /*< private >*/
+  gpointer dummy[128];
+};
+
+typedef enum {
+  G_CO_PRIORITY_HIGH    = -1,
+  G_CO_PRIORITY_DEFAULT = 0,
+  G_CO_PRIORITY_LOW     = 1,
+} GCoPriority;
+
+#define G_CO_PRIORITY_AGING 8
 
 GCOROUTINE_AVAILABLE_IN_1_0
 GCoroutine *           g_coroutine_new       (GCoroutineFunc func);
 GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_coroutine_new_batch (GCoroutineFunc func,
+                                              guint          n,
+                                              GCoroutine   **coroutines);
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoroutine *           g_coroutine_init_static (GCoroutineStorage *storage,
+                                                gpointer       stack,
+                                                gsize          stack_size,
+                                                GCoroutineFunc func);
+GCOROUTINE_AVAILABLE_IN_1_0
 GCoroutine *           g_coroutine_ref       (GCoroutine    *coroutine);
 GCOROUTINE_AVAILABLE_IN_1_0
 void                   g_coroutine_unref     (GCoroutine    *coroutine);
 GCOROUTINE_AVAILABLE_IN_1_0
 gboolean               g_coroutine_resumable (GCoroutine    *coroutine);
 GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_coroutine_set_priority (GCoroutine *coroutine,
+                                                 GCoPriority priority);
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoPriority            g_coroutine_get_priority (GCoroutine *coroutine);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_coroutine_wakeup    (GCoroutine    *coroutine);
+GCOROUTINE_AVAILABLE_IN_1_0
+gpointer               g_coroutine_join      (GCoroutine    *coroutine) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_coroutine_cancel    (GCoroutine    *coroutine);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_coroutine_is_cancelled (GCoroutine *coroutine);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_async_ready      (gpointer       source_object,
+                                              gpointer       result,
+                                              gpointer       coroutine);
+GCOROUTINE_AVAILABLE_IN_1_0
+gpointer               g_co_async_yield      (void) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
 gpointer               g_coroutine_resume    (GCoroutine    *coroutine,
                                               gpointer       data);
 GCOROUTINE_AVAILABLE_IN_1_0
 gpointer               g_coroutine_yield     (gpointer       data) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
+const GCoValue *       g_coroutine_resume_values (GCoroutine     *coroutine,
+                                                  const GCoValue *values,
+                                                  guint           n_values);
+GCOROUTINE_AVAILABLE_IN_1_0
+const GCoValue *       g_coroutine_yield_values  (const GCoValue *values,
+                                                  guint           n_values) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gpointer               g_coroutine_alloc     (gsize          n_bytes) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gpointer               g_coroutine_alloc0    (gsize          n_bytes) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
 GCoroutine *           g_coroutine_self      (void) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
 gboolean               g_in_coroutine        (void);
 
+typedef struct _GCoPrivate GCoPrivate;
+struct _GCoPrivate {
+  /*< private >*/
+  guint          index;
+  GDestroyNotify notify;
+};
+
+#define G_CO_PRIVATE_INIT(notify) { 0, (notify) }
+
+GCOROUTINE_AVAILABLE_IN_1_0
+gpointer               g_co_private_get      (GCoPrivate    *key);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_private_set      (GCoPrivate    *key,
+                                              gpointer       value);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_private_replace  (GCoPrivate    *key,
+                                              gpointer       value);
+
 typedef struct _GCoQueue GCoQueue;
 struct _GCoQueue {
   /*< private >*/
@@ -73,7 +154,15 @@ GCOROUTINE_AVAILABLE_IN_1_0
 gpointer               g_co_queue_yield      (GCoQueue      *queue,
                                               gpointer       data) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
-gboolean               g_co_queue_schedule   (GCoQueue      *queue,
+gboolean               g_co_queue_yield_timed(GCoQueue      *queue,
+                                              gpointer       data,
+                                              gint64         end_time) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gint                   g_co_queue_select     (GCoQueue     **queues,
+                                              guint          n_queues,
+                                              gpointer       data) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gint                   g_co_queue_schedule   (GCoQueue      *queue,
                                               gint           n) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
 gboolean               g_co_queue_is_empty   (GCoQueue      *queue);
@@ -81,40 +170,135 @@ GCOROUTINE_AVAILABLE_IN_1_0
 gpointer               g_co_queue_resume_head(GCoQueue      *queue,
                                               gpointer       data);
 
+typedef enum {
+  G_CO_MUTEX_DEFAULT     = 0,
+  G_CO_MUTEX_FAIR        = 1 << 0,
+  G_CO_MUTEX_THREAD_SAFE = 1 << 1,
+} GCoMutexFlags;
+
 typedef struct _GCoMutex GCoMutex;
 struct _GCoMutex {
   /*< private >*/
   GCoQueue queue;
   gboolean locked;
+  GCoMutexFlags flags;
+  GCoroutine *handoff;
+  gint wait_lock;
 };
 
 GCOROUTINE_AVAILABLE_IN_1_0
 void                   g_co_mutex_init       (GCoMutex      *mutex);
 GCOROUTINE_AVAILABLE_IN_1_0
-void                   g_co_mutex_lock       (GCoMutex      *mutex) G_COROUTINE_FUNC;
+void                   g_co_mutex_init_full  (GCoMutex      *mutex,
+                                              GCoMutexFlags  flags);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_mutex_lock       (GCoMutex      *mutex) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_mutex_lock_timed (GCoMutex      *mutex,
+                                              gint64         end_time) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
 void                   g_co_mutex_unlock     (GCoMutex      *mutex) G_COROUTINE_FUNC;
 
+typedef struct _GCoCond GCoCond;
+struct _GCoCond {
+  /*< private >*/
+  GCoQueue queue;
+  GCoMutex *mutex;
+};
+
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_cond_init        (GCoCond       *cond);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_cond_wait        (GCoCond       *cond,
+                                              GCoMutex      *mutex) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_cond_signal      (GCoCond       *cond) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_cond_broadcast   (GCoCond       *cond) G_COROUTINE_FUNC;
+
+typedef struct _GCoSemaphore GCoSemaphore;
+struct _GCoSemaphore {
+  /*< private >*/
+  GCoQueue queue;
+  guint value;
+};
+
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_semaphore_init        (GCoSemaphore *sem,
+                                                   guint         value);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_semaphore_acquire     (GCoSemaphore *sem,
+                                                   guint         n) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_semaphore_try_acquire (GCoSemaphore *sem,
+                                                   guint         n);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_semaphore_release     (GCoSemaphore *sem,
+                                                   guint         n) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+guint                  g_co_semaphore_get_value   (GCoSemaphore *sem);
+
+typedef struct _GCoWaitGroup GCoWaitGroup;
+struct _GCoWaitGroup {
+  /*< private >*/
+  GCoQueue queue;
+  gint count;
+};
+
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_wait_group_init       (GCoWaitGroup *wg);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_wait_group_add        (GCoWaitGroup *wg,
+                                                   gint          delta) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_wait_group_done       (GCoWaitGroup *wg) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_wait_group_wait       (GCoWaitGroup *wg) G_COROUTINE_FUNC;
+
+typedef enum {
+  G_CO_RW_LOCK_PREFER_READER,
+  G_CO_RW_LOCK_PREFER_WRITER,
+  G_CO_RW_LOCK_PHASE_FAIR,
+} GCoRWLockPolicy;
+
 typedef struct _GCoRWLock GCoRWLock;
 struct _GCoRWLock {
     /*< private >*/
-    GCoQueue queue;
+    GCoQueue readers;
+    GCoQueue writers;
     gint reader;
     gboolean writer;
+    GCoRWLockPolicy policy;
 };
 
 GCOROUTINE_AVAILABLE_IN_1_0
 void                   g_co_rw_lock_init         (GCoRWLock *lock);
 GCOROUTINE_AVAILABLE_IN_1_0
-void                   g_co_rw_lock_reader_lock  (GCoRWLock *lock) G_COROUTINE_FUNC;
+void                   g_co_rw_lock_init_full    (GCoRWLock *lock,
+                                                  GCoRWLockPolicy policy);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_rw_lock_reader_lock  (GCoRWLock *lock) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_rw_lock_reader_lock_timed (GCoRWLock *lock,
+                                                       gint64     end_time) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
 void                   g_co_rw_lock_reader_unlock(GCoRWLock *lock) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
-void                   g_co_rw_lock_writer_lock  (GCoRWLock *lock) G_COROUTINE_FUNC;
+gboolean               g_co_rw_lock_writer_lock  (GCoRWLock *lock) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_rw_lock_writer_lock_timed (GCoRWLock *lock,
+                                                       gint64     end_time) G_COROUTINE_FUNC;
 GCOROUTINE_AVAILABLE_IN_1_0
 void                   g_co_rw_lock_writer_unlock(GCoRWLock *lock) G_COROUTINE_FUNC;
 
 G_END_DECLS
 
+#include "gcochannel.h"
+#include "gcoscheduler.h"
+#include "gcopool.h"
+#include "gcoscope.h"
+#include "gcotimer.h"
+#include "gcoreactor.h"
+#include "gcouring.h"
 
 #endif /* __G_COROUTINE_H__ */
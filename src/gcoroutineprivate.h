@@ -24,14 +24,73 @@
 
 #include "gcoroutine.h"
 
+#define G_CO_PRIVATE_MAX 16
+
+/* Header of a memory block shared by coroutines created with
+ * g_coroutine_new_batch(), freed along with the last of them */
+typedef struct {
+  gint                    ref_count;
+} GCoroutineBatch;
+
+typedef struct _GCoArenaChunk GCoArenaChunk;
+
+#define G_CO_N_PRIORITIES (G_CO_PRIORITY_LOW - G_CO_PRIORITY_HIGH + 1)
+
+/* The thread a coroutine was first resumed in, where
+ * g_coroutine_wakeup() resumes it from its main context */
+typedef struct _GCoHome GCoHome;
+
+/* A worker thread of a GCoPool */
+typedef struct _GCoWorker GCoWorker;
+
+/* The handshake between a pool coroutine waiting to be woken up from
+ * another thread and its worker, see _g_co_pool_park() */
+enum {
+  CO_PARK_NONE,
+  CO_PARK_PARKING,              /* still running on its worker */
+  CO_PARK_PARKED,               /* switched out */
+  CO_PARK_WOKEN,                /* woken up before it switched out */
+};
+
 struct _GCoroutine {
   gint                    ref_count;
   GCoroutineFunc          func;
   gpointer                data;
   GCoroutine             *caller;
   GQueue                  resume_queue;
+  GCoValue                values[G_COROUTINE_MAX_VALUES];
+  gpointer                privates[G_CO_PRIVATE_MAX];
+  GCoArenaChunk          *arena;
+  gpointer                wait_data;      /* set while blocked on a GCoQueue */
+  GCoQueue              **wait_queues;    /* the queues it is blocked on */
+  GList                  *wait_links;     /* its links in each of them */
+  guint                   n_waits;
+  gint                    wait_index;     /* the queue that scheduled it */
+  gboolean                cancellable;    /* blocked, until scheduled */
+  gboolean                cancelled;
+  GCoHome                *home;
+  GCoQueue                joiners;        /* in g_coroutine_join() */
+  GSource                *scheduler;      /* that last dispatched it */
+  GList                   run_link;       /* in a scheduler or pool run-queue */
+  gpointer                run_data;       /* or the data of a scope child */
+  GCoScope               *scope;          /* that spawned it */
+  GCoroutineFunc          scope_func;
+  gboolean                migratable;     /* between the threads of a pool */
+  GCoWorker              *worker;         /* the pool worker resuming it */
+  GCoWorker              *last_worker;    /* that resumed it last */
+  GCoPool                *pool;           /* it was added to */
+  gint                    park;           /* a CO_PARK_* state */
+  GCoPriority             priority;
+  guint                   bypassed;       /* by higher priorities, while queued */
+  gpointer                async_result;   /* in g_co_async_yield() */
+  gboolean                terminated;
+  GCoroutine             *wakeup_next;    /* in home->wakeups */
+  gboolean                is_static;
+  GCoroutineBatch        *batch;
 };
 
+#define G_COROUTINE_STACK_SIZE (1 << 20)
+
 typedef enum {
   GCOROUTINE_YIELD      = 1,
   GCOROUTINE_TERMINATE  = 2,
@@ -42,8 +101,18 @@ GCoroutineAction          _g_coroutine_switch         (GCoroutine *from_,
                                                        GCoroutineAction action);
 
 GCoroutine *              _g_coroutine_new            (void);
+GCoroutine *              _g_coroutine_init_static    (GCoroutineStorage *storage,
+                                                       gpointer    stack,
+                                                       gsize       stack_size);
+void                      _g_coroutine_new_batch      (GCoroutine **coroutines,
+                                                       guint        n);
 void                      _g_coroutine_free           (GCoroutine *co_);
 gboolean                  _g_in_coroutine             (void);
+void                      _g_coroutine_run            (GCoroutine *co_);
 GCoroutine *              _g_coroutine_self           (void);
 
+gboolean                  _g_co_pool_yield            (void);
+void                      _g_co_pool_park             (void);
+void                      _g_co_pool_wakeup           (GCoroutine *co_);
+
 #endif /* __G_COROUTINEPRIVATE_H__ */
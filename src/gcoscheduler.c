@@ -0,0 +1,377 @@
+/*
+ * GLib coroutine scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcoscheduler
+ * @title: Scheduler
+ * @short_description: running coroutines from a main loop
+ * @see_also: #GMainContext, #GMainLoop
+ *
+ * Each #GMainContext can have a scheduler, a #GSource created on
+ * demand which owns a run-queue of coroutines ready to run. Coroutines
+ * are added to it with g_coroutine_spawn(), and the scheduler resumes
+ * them in FIFO order when the context is iterated, for example by a
+ * #GMainLoop.
+ *
+ * A coroutine run by a scheduler can give the other coroutines and
+ * the other sources of the context a chance to run with
+ * g_co_yield_to_loop(). At most %G_CO_SCHEDULER_BATCH coroutines are
+ * resumed per dispatch, and the coroutines queued again meanwhile wait
+ * for the next dispatch, so that the main loop stays responsive even
+ * when there are always coroutines ready to run.
+ *
+ * There is a run-queue per #GCoPriority: the scheduler resumes the
+ * coroutines of the highest priority first, but a coroutine passed
+ * over %G_CO_PRIORITY_AGING times goes before them.
+ *
+ * A coroutine running a long computation, such as parsing a large
+ * payload, would otherwise hold its thread until it is done. It can
+ * let the others run with g_co_reschedule(), which also works from a
+ * #GCoPool, at a steady pace with a #GCoBudget:
+ *
+ * |[
+ *   GCoBudget budget;
+ *
+ *   g_co_budget_init (&budget, 2000);
+ *   while (parse_next_element (parser))
+ *     g_co_budget_tick (&budget);
+ * ]|
+ */
+
+/* The bounds of the number of ticks between two reads of the clock */
+#define CO_BUDGET_MIN_STRIDE 1
+#define CO_BUDGET_MAX_STRIDE 4096
+
+typedef struct {
+  GSource       source;
+  GQueue        run_queues[G_CO_N_PRIORITIES];  /* linked by GCoroutine::run_link */
+  guint         bypassed[G_CO_N_PRIORITIES];    /* for the heads of the queues */
+  guint         length;
+} CoScheduler;
+
+/* The scheduler last used by a thread, which usually spawns on a
+ * single context */
+typedef struct {
+  GMainContext *context;
+  GSource      *source;
+} CoSchedulerCache;
+
+static G_LOCK_DEFINE (co_scheduler);
+
+static void
+co_scheduler_cache_free (gpointer data)
+{
+  CoSchedulerCache *cache = data;
+
+  if (cache->source)
+    g_source_unref (cache->source);
+  g_slice_free (CoSchedulerCache, cache);
+}
+
+static GPrivate co_scheduler_cache = G_PRIVATE_INIT (co_scheduler_cache_free);
+
+/* Pops the coroutine of the highest priority, or the first one to be
+ * passed over too many times */
+static GCoroutine *
+co_scheduler_pop (CoScheduler *sched)
+{
+  gint i, pick = -1;
+
+  for (i = 0; i < G_CO_N_PRIORITIES; i++)
+    {
+      if (g_queue_is_empty (&sched->run_queues[i]))
+        continue;
+
+      if (pick == -1)
+        pick = i;
+      else if (++sched->bypassed[i] > G_CO_PRIORITY_AGING)
+        {
+          pick = i;
+          break;
+        }
+    }
+
+  sched->bypassed[pick] = 0;
+  sched->length--;
+
+  return g_queue_pop_head_link (&sched->run_queues[pick])->data;
+}
+
+static gboolean
+co_scheduler_dispatch (GSource     *source,
+                       GSourceFunc  callback,
+                       gpointer     user_data)
+{
+  CoScheduler *sched = (CoScheduler *)source;
+  guint n = MIN (sched->length, G_CO_SCHEDULER_BATCH);
+
+  while (n-- > 0)
+    {
+      GCoroutine *co = co_scheduler_pop (sched);
+      gpointer data = co->run_data;
+
+      co->run_data = NULL;
+      co->scheduler = source;
+      g_coroutine_resume (co, data);
+      g_coroutine_unref (co);
+    }
+
+  if (sched->length == 0)
+    g_source_set_ready_time (source, -1);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Releases the coroutines still queued */
+static void
+co_scheduler_finalize (GSource *source)
+{
+  CoScheduler *sched = (CoScheduler *)source;
+  GList *link;
+  gint i;
+
+  for (i = 0; i < G_CO_N_PRIORITIES; i++)
+    while ((link = g_queue_pop_head_link (&sched->run_queues[i])))
+      {
+        GCoroutine *co = link->data;
+
+        co->run_data = NULL;
+        g_coroutine_unref (co);
+      }
+  sched->length = 0;
+}
+
+static GSourceFuncs co_scheduler_funcs = {
+  NULL,
+  NULL,
+  co_scheduler_dispatch,
+  co_scheduler_finalize
+};
+
+/* Returns the scheduler of @context, creating it if needed */
+static CoScheduler *
+co_scheduler_get (GMainContext *context)
+{
+  CoSchedulerCache *cache = g_private_get (&co_scheduler_cache);
+  GSource *source;
+  gint i;
+
+  /* a destroyed source may belong to a freed context at the same
+   * address */
+  if (G_LIKELY (cache != NULL && cache->context == context &&
+                !g_source_is_destroyed (cache->source)))
+    return (CoScheduler *)cache->source;
+
+  G_LOCK (co_scheduler);
+  source = g_main_context_find_source_by_funcs_user_data (context,
+                                                          &co_scheduler_funcs,
+                                                          NULL);
+  if (source == NULL)
+    {
+      source = g_source_new (&co_scheduler_funcs, sizeof (CoScheduler));
+      g_source_set_name (source, "GCoroutine scheduler");
+      /* without callback, the source couldn't be found again */
+      g_source_set_callback (source, NULL, NULL, NULL);
+      for (i = 0; i < G_CO_N_PRIORITIES; i++)
+        g_queue_init (&((CoScheduler *)source)->run_queues[i]);
+      g_source_attach (source, context);
+    }
+  else
+    g_source_ref (source);
+  G_UNLOCK (co_scheduler);
+
+  if (cache == NULL)
+    {
+      cache = g_slice_new0 (CoSchedulerCache);
+      g_private_set (&co_scheduler_cache, cache);
+    }
+  if (cache->source)
+    g_source_unref (cache->source);
+  cache->context = context;
+  cache->source = source;
+
+  return (CoScheduler *)source;
+}
+
+/* Queues @co, taking over a reference on it */
+static void
+co_scheduler_push (CoScheduler *sched,
+                   GCoroutine  *co,
+                   gpointer     data)
+{
+  co->run_data = data;
+  co->run_link.data = co;
+  g_queue_push_tail_link (&sched->run_queues[co->priority - G_CO_PRIORITY_HIGH],
+                          &co->run_link);
+
+  if (++sched->length == 1)
+    g_source_set_ready_time (&sched->source, 0);
+}
+
+/**
+ * g_coroutine_spawn:
+ * @context: (nullable): a #GMainContext, or %NULL for the
+ *     thread-default main context
+ * @func: a function to execute in the new coroutine
+ * @data: the argument to pass to @func
+ *
+ * Creates a new coroutine running @func, and adds it to the run-queue
+ * of the scheduler of @context. It is entered with @data once
+ * @context is iterated.
+ *
+ * This function must be called from the thread that iterates
+ * @context. Use g_coroutine_wakeup() to resume a coroutine from
+ * another thread.
+ *
+ * Returns: (transfer none): the new #GCoroutine, which is freed when
+ * @func returns, unless g_coroutine_ref() was used
+ **/
+GCoroutine *
+g_coroutine_spawn (GMainContext   *context,
+                   GCoroutineFunc  func,
+                   gpointer        data)
+{
+  GCoroutine *co;
+
+  g_return_val_if_fail (func != NULL, NULL);
+
+  if (context == NULL)
+    context = g_main_context_get_thread_default ();
+
+  co = g_coroutine_new (func);
+  co_scheduler_push (co_scheduler_get (context), co, data);
+
+  return co;
+}
+
+/**
+ * g_co_yield_to_loop:
+ *
+ * Adds the current coroutine back to the run-queue of the scheduler
+ * that last resumed it, or of the thread-default main context, and
+ * yields %NULL to the caller of the current coroutine. The coroutine
+ * is resumed by the scheduler after the coroutines and the sources
+ * that are already ready.
+ *
+ * The current coroutine must not be resumed by other means until the
+ * scheduler does.
+ **/
+void
+g_co_yield_to_loop (void) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  CoScheduler *sched;
+
+  g_return_if_fail (g_in_coroutine ());
+
+  if (self->scheduler)
+    sched = (CoScheduler *)self->scheduler;
+  else
+    sched = co_scheduler_get (g_main_context_get_thread_default ());
+
+  co_scheduler_push (sched, g_coroutine_ref (self), NULL);
+  g_coroutine_yield (NULL);
+}
+
+/**
+ * g_co_reschedule:
+ *
+ * Puts the current coroutine at the tail of its run-queue, and lets
+ * the next coroutine ready to run go first. From a #GCoPool, this is
+ * g_co_pool_yield(), otherwise g_co_yield_to_loop().
+ **/
+void
+g_co_reschedule (void) G_COROUTINE_FUNC
+{
+  g_return_if_fail (g_in_coroutine ());
+
+  if (!_g_co_pool_yield ())
+    g_co_yield_to_loop ();
+}
+
+/**
+ * GCoBudget:
+ *
+ * A time slice for a coroutine running a long computation, see
+ * g_co_budget_tick().
+ */
+
+/**
+ * g_co_budget_init:
+ * @budget: a #GCoBudget
+ * @usec: the length of the time slices, in microseconds
+ *
+ * Initializes @budget, and starts its first time slice.
+ **/
+void
+g_co_budget_init (GCoBudget *budget,
+                  gint64     usec)
+{
+  g_return_if_fail (budget != NULL);
+  g_return_if_fail (usec > 0);
+
+  budget->usec = usec;
+  budget->checked = g_get_monotonic_time ();
+  budget->deadline = budget->checked + usec;
+  budget->stride = CO_BUDGET_MIN_STRIDE;
+  budget->countdown = budget->stride;
+}
+
+/**
+ * g_co_budget_check:
+ * @budget: a #GCoBudget
+ *
+ * Called by g_co_budget_tick() every so many ticks: reschedules the
+ * current coroutine if the time slice of @budget is spent. The number
+ * of ticks until the next check is adjusted from the time the last
+ * ones took, for about 8 checks per time slice.
+ *
+ * Returns: %TRUE if the current coroutine was rescheduled
+ **/
+gboolean
+g_co_budget_check (GCoBudget *budget) G_COROUTINE_FUNC
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed = now - budget->checked;
+  gboolean expired = now >= budget->deadline;
+
+  if (elapsed > 0)
+    budget->stride = CLAMP (budget->stride * (budget->usec / 8) / elapsed,
+                            CO_BUDGET_MIN_STRIDE, CO_BUDGET_MAX_STRIDE);
+  else
+    budget->stride = MIN (budget->stride * 2, CO_BUDGET_MAX_STRIDE);
+
+  if (expired)
+    {
+      g_co_reschedule ();
+      now = g_get_monotonic_time ();
+      budget->deadline = now + budget->usec;
+    }
+
+  budget->checked = now;
+  budget->countdown = budget->stride;
+
+  return expired;
+}
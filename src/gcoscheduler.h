@@ -0,0 +1,81 @@
+/*
+ * GLib coroutine scheduler
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __G_CO_SCHEDULER_H__
+#define __G_CO_SCHEDULER_H__
+
+#if !defined(GCOROUTINE_H_INSIDE) && !defined(GCOROUTINE_COMPILATION)
+#error "Only gcoroutine.h can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+/**
+ * G_CO_SCHEDULER_BATCH:
+ *
+ * The maximum number of coroutines resumed by the scheduler of a
+ * #GMainContext in a single dispatch.
+ */
+#define G_CO_SCHEDULER_BATCH 64
+
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoroutine *           g_coroutine_spawn         (GMainContext   *context,
+                                                  GCoroutineFunc  func,
+                                                  gpointer        data);
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_yield_to_loop        (void) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_reschedule           (void) G_COROUTINE_FUNC;
+
+typedef struct _GCoBudget GCoBudget;
+struct _GCoBudget {
+  /*< private >*/
+  guint  countdown;
+  guint  stride;
+  gint64 usec;
+  gint64 checked;
+  gint64 deadline;
+};
+
+/**
+ * g_co_budget_tick:
+ * @budget: a #GCoBudget
+ *
+ * Accounts for a unit of work of a long computation. Once the time
+ * slice of @budget is spent, the current coroutine is rescheduled with
+ * g_co_reschedule(), and a new time slice starts when it resumes.
+ *
+ * This only decrements a counter, and reads the clock in
+ * g_co_budget_check() every so many ticks, so it can be called in
+ * tight loops.
+ *
+ * Returns: %TRUE if the current coroutine was rescheduled
+ */
+#define g_co_budget_tick(budget) \
+  (G_UNLIKELY (--(budget)->countdown == 0) && g_co_budget_check (budget))
+
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_budget_init          (GCoBudget      *budget,
+                                                  gint64          usec);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_budget_check         (GCoBudget      *budget) G_COROUTINE_FUNC;
+
+G_END_DECLS
+
+#endif /* __G_CO_SCHEDULER_H__ */
@@ -0,0 +1,257 @@
+/*
+ * GLib coroutine scopes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcoscope
+ * @title: Scopes
+ * @short_description: structured concurrency
+ * @see_also: g_coroutine_cancel()
+ *
+ * A #GCoScope bounds the lifetime of the coroutines it spawns: a
+ * coroutine creates a scope, spawns children in it with
+ * g_co_scope_spawn(), and g_co_scope_join() returns only once all of
+ * them returned. No child outlives the scope, even when something
+ * goes wrong:
+ *
+ * |[
+ *   GCoScope *scope = g_co_scope_new ();
+ *
+ *   for (i = 0; i < n_peers; i++)
+ *     g_co_scope_spawn (scope, fetch_from_peer, peers[i]);
+ *
+ *   if (!g_co_scope_join (scope, &error))
+ *     return handle_error (error);
+ * ]|
+ *
+ * A child fails with g_co_scope_return_error(): the first error is
+ * the one returned by g_co_scope_join(), and the other children are
+ * cancelled with g_coroutine_cancel(), so they give up waiting and
+ * return. Cancelling the coroutine joining the scope cancels its
+ * children the same way.
+ *
+ * The children are started together once the spawning coroutine
+ * yields, from its resume queue, and run in its thread.
+ */
+
+struct _GCoScope {
+  GPtrArray    *children;       /* with a reference */
+  guint         n_running;
+  GCoQueue      joiner;
+  GError       *error;          /* the first one */
+};
+
+G_DEFINE_QUARK (g-co-scope-error-quark, g_co_scope_error)
+
+/**
+ * g_co_scope_new:
+ *
+ * Creates a new scope, to spawn coroutines in.
+ *
+ * Returns: (transfer full): a new #GCoScope, freed by
+ * g_co_scope_join()
+ **/
+GCoScope *
+g_co_scope_new (void)
+{
+  GCoScope *scope = g_slice_new0 (GCoScope);
+
+  scope->children =
+    g_ptr_array_new_with_free_func ((GDestroyNotify) g_coroutine_unref);
+  g_co_queue_init (&scope->joiner);
+
+  return scope;
+}
+
+/* Cancels the running children, but @except */
+static void
+co_scope_cancel (GCoScope   *scope,
+                 GCoroutine *except)
+{
+  guint i;
+
+  for (i = 0; i < scope->children->len; i++)
+    {
+      GCoroutine *co = g_ptr_array_index (scope->children, i);
+
+      if (co != except && !co->terminated)
+        g_coroutine_cancel (co);
+    }
+}
+
+static gpointer
+co_scope_run (gpointer data) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GCoScope *scope = self->scope;
+
+  data = self->scope_func (self->run_data);
+
+  /* the joiner resumes once this coroutine switched back */
+  if (--scope->n_running == 0)
+    g_co_queue_schedule (&scope->joiner, -1);
+
+  return data;
+}
+
+/**
+ * g_co_scope_spawn:
+ * @scope: a #GCoScope
+ * @func: a function to execute in the new coroutine
+ * @data: the argument to pass to @func
+ *
+ * Creates a new coroutine running @func in @scope. It is entered with
+ * @data once the current coroutine yields, along with the other
+ * children spawned meanwhile. If @scope is already cancelled, the new
+ * coroutine is cancelled as well.
+ *
+ * Returns: (transfer none): the new #GCoroutine, owned by @scope
+ **/
+GCoroutine *
+g_co_scope_spawn (GCoScope       *scope,
+                  GCoroutineFunc  func,
+                  gpointer        data) G_COROUTINE_FUNC
+{
+  GCoroutine *co;
+
+  g_return_val_if_fail (scope != NULL, NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+  g_return_val_if_fail (g_in_coroutine (), NULL);
+
+  co = g_coroutine_new (co_scope_run);
+  co->scope = scope;
+  co->scope_func = func;
+  co->run_data = data;
+  if (scope->error != NULL)
+    co->cancelled = TRUE;
+
+  g_ptr_array_add (scope->children, co);
+  scope->n_running++;
+  g_queue_push_tail (&g_coroutine_self ()->resume_queue, co);
+
+  return co;
+}
+
+/**
+ * g_co_scope_return_error:
+ * @error: (transfer full): the #GError of the failure
+ *
+ * Reports the failure of the current coroutine, which must have been
+ * spawned with g_co_scope_spawn(). Unless another child of the scope
+ * failed before, @error is returned by g_co_scope_join() and the
+ * other children are cancelled. The current coroutine is expected to
+ * return afterwards.
+ **/
+void
+g_co_scope_return_error (GError *error) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GCoScope *scope = self->scope;
+
+  g_return_if_fail (error != NULL);
+  g_return_if_fail (scope != NULL);
+
+  if (scope->error != NULL)
+    {
+      g_error_free (error);
+      return;
+    }
+
+  scope->error = error;
+  co_scope_cancel (scope, self);
+}
+
+/**
+ * g_co_scope_cancel:
+ * @scope: a #GCoScope
+ *
+ * Cancels all the children of @scope with g_coroutine_cancel(), and
+ * the ones spawned later. Unless a child failed before,
+ * g_co_scope_join() then returns %G_CO_SCOPE_ERROR_CANCELLED.
+ **/
+void
+g_co_scope_cancel (GCoScope *scope)
+{
+  g_return_if_fail (scope != NULL);
+
+  if (scope->error != NULL)
+    return;
+
+  scope->error = g_error_new_literal (G_CO_SCOPE_ERROR,
+                                      G_CO_SCOPE_ERROR_CANCELLED,
+                                      "The scope was cancelled");
+  co_scope_cancel (scope, NULL);
+}
+
+/**
+ * g_co_scope_join:
+ * @scope: (transfer full): a #GCoScope
+ * @error: return location for a #GError, or %NULL
+ *
+ * Waits for all the children of @scope to return, and frees @scope.
+ * If the current coroutine is cancelled meanwhile, @scope is
+ * cancelled, but this function still waits for the children.
+ *
+ * Returns: %FALSE if a child failed or @scope was cancelled, in which
+ * case @error is set
+ **/
+gboolean
+g_co_scope_join (GCoScope  *scope,
+                 GError   **error) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GError *scope_error;
+  gboolean cancelled;
+
+  g_return_val_if_fail (scope != NULL, FALSE);
+  g_return_val_if_fail (g_in_coroutine (), FALSE);
+
+  /* the children must return before the scope does, keep waiting */
+  cancelled = self->cancelled;
+  while (scope->n_running > 0)
+    {
+      if (self->cancelled)
+        {
+          cancelled = TRUE;
+          self->cancelled = FALSE;
+          g_co_scope_cancel (scope);
+          continue;
+        }
+
+      g_co_queue_yield (&scope->joiner, NULL);
+    }
+  self->cancelled = cancelled;
+
+  scope_error = scope->error;
+  g_ptr_array_unref (scope->children);
+  g_slice_free (GCoScope, scope);
+
+  if (scope_error != NULL)
+    {
+      g_propagate_error (error, scope_error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,67 @@
+/*
+ * GLib coroutine scopes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __G_CO_SCOPE_H__
+#define __G_CO_SCOPE_H__
+
+#if !defined(GCOROUTINE_H_INSIDE) && !defined(GCOROUTINE_COMPILATION)
+#error "Only gcoroutine.h can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+/**
+ * G_CO_SCOPE_ERROR:
+ *
+ * Error domain for #GCoScope. Errors in this domain will be from the
+ * #GCoScopeError enumeration.
+ */
+#define G_CO_SCOPE_ERROR (g_co_scope_error_quark ())
+
+/**
+ * GCoScopeError:
+ * @G_CO_SCOPE_ERROR_CANCELLED: the scope was cancelled
+ *
+ * Error codes returned by g_co_scope_join().
+ */
+typedef enum {
+  G_CO_SCOPE_ERROR_CANCELLED,
+} GCoScopeError;
+
+typedef struct _GCoScope GCoScope;
+
+GCOROUTINE_AVAILABLE_IN_1_0
+GQuark                 g_co_scope_error_quark    (void);
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoScope *             g_co_scope_new            (void);
+GCOROUTINE_AVAILABLE_IN_1_0
+GCoroutine *           g_co_scope_spawn          (GCoScope       *scope,
+                                                  GCoroutineFunc  func,
+                                                  gpointer        data) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_scope_return_error   (GError         *error) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+void                   g_co_scope_cancel         (GCoScope       *scope);
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_scope_join           (GCoScope       *scope,
+                                                  GError        **error) G_COROUTINE_FUNC;
+
+G_END_DECLS
+
+#endif /* __G_CO_SCOPE_H__ */
@@ -0,0 +1,322 @@
+/*
+ * GLib coroutine timers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcotimer
+ * @title: Timers
+ * @short_description: putting coroutines to sleep
+ * @see_also: g_timeout_add()
+ *
+ * g_co_sleep() and g_co_sleep_until() suspend the current coroutine
+ * until a deadline, without allocating memory or creating a #GSource
+ * per sleeping coroutine.
+ *
+ * The sleeping coroutines of a thread are kept in a hierarchical
+ * timing wheel with a resolution of a millisecond: four levels of 64
+ * slots, each slot of a level covering 64 times more time than a slot
+ * of the level below. Adding or removing a timer costs the same with
+ * a million timers as with one, and the timers of a slot move down a
+ * level only when their deadline comes close. A single #GSource
+ * attached to the thread-default main context when the first
+ * coroutine of the thread goes to sleep wakes them all up.
+ */
+
+#define CO_WHEEL_BITS   6
+#define CO_WHEEL_SLOTS  (1 << CO_WHEEL_BITS)
+#define CO_WHEEL_LEVELS 4
+
+typedef struct {
+  GList         link;           /* in a slot, or the expired queue */
+  GQueue       *queue;
+  guint         level;
+  gint64        expires;        /* in ticks of the wheel */
+  GCoroutine   *co;
+  gboolean      fired;
+} CoTimer;
+
+typedef struct {
+  GSource       source;
+  gint64        tick;           /* the last one processed */
+  gint64        next;           /* the next one to process, or -1 */
+  guint         counts[CO_WHEEL_LEVELS];
+  GQueue        slots[CO_WHEEL_LEVELS][CO_WHEEL_SLOTS];
+  GQueue        expired;        /* to be resumed */
+} CoWheel;
+
+#define CO_WHEEL_SHIFT(level) ((level) * CO_WHEEL_BITS)
+#define CO_WHEEL_INDEX(tick, level) (((tick) >> CO_WHEEL_SHIFT (level)) & (CO_WHEEL_SLOTS - 1))
+
+static void
+co_wheel_free (GSource *source)
+{
+  g_source_destroy (source);
+  g_source_unref (source);
+}
+
+static GPrivate co_wheel_key = G_PRIVATE_INIT ((GDestroyNotify) co_wheel_free);
+
+static gint64
+co_wheel_now (void)
+{
+  return g_get_monotonic_time () / 1000;
+}
+
+/* Adds @timer to @wheel, expiring at @timer->expires, which is at
+ * least the current tick. Returns the tick it has to be looked at. */
+static gint64
+co_wheel_insert (CoWheel *wheel,
+                 CoTimer *timer)
+{
+  gint64 delta = timer->expires - wheel->tick;
+  gint64 place = timer->expires;
+  guint level;
+
+  for (level = 0; level < CO_WHEEL_LEVELS - 1; level++)
+    if (delta < G_GINT64_CONSTANT (1) << CO_WHEEL_SHIFT (level + 1))
+      break;
+
+  /* beyond the wheel, wait in its last slot and insert again */
+  if (delta >= G_GINT64_CONSTANT (1) << CO_WHEEL_SHIFT (CO_WHEEL_LEVELS))
+    place = ((wheel->tick >> CO_WHEEL_SHIFT (level)) + CO_WHEEL_SLOTS - 1)
+      << CO_WHEEL_SHIFT (level);
+
+  timer->level = level;
+  timer->queue = &wheel->slots[level][CO_WHEEL_INDEX (place, level)];
+  g_queue_push_tail_link (timer->queue, &timer->link);
+  wheel->counts[level]++;
+
+  return place >> CO_WHEEL_SHIFT (level) << CO_WHEEL_SHIFT (level);
+}
+
+static void
+co_wheel_remove (CoWheel *wheel,
+                 CoTimer *timer)
+{
+  g_queue_unlink (timer->queue, &timer->link);
+  if (timer->level < CO_WHEEL_LEVELS)
+    wheel->counts[timer->level]--;
+  timer->queue = NULL;
+}
+
+/* Returns the next tick where timers expire or move down a level */
+static gint64
+co_wheel_next (CoWheel *wheel)
+{
+  gint64 next = -1;
+  guint level, k;
+
+  for (level = 0; level < CO_WHEEL_LEVELS; level++)
+    {
+      gint64 base = wheel->tick >> CO_WHEEL_SHIFT (level);
+
+      if (wheel->counts[level] == 0)
+        continue;
+
+      for (k = 1; k <= CO_WHEEL_SLOTS; k++)
+        if (!g_queue_is_empty (&wheel->slots[level][CO_WHEEL_INDEX ((base + k) << CO_WHEEL_SHIFT (level), level)]))
+          {
+            gint64 tick = (base + k) << CO_WHEEL_SHIFT (level);
+
+            if (next == -1 || tick < next)
+              next = tick;
+            break;
+          }
+    }
+
+  return next;
+}
+
+static void
+co_wheel_arm (CoWheel *wheel,
+              gint64   next)
+{
+  wheel->next = next;
+  g_source_set_ready_time (&wheel->source, next == -1 ? -1 : next * 1000);
+}
+
+/* Processes @tick: moves the slots starting there down a level, and
+ * the timers expiring then to the expired queue */
+static void
+co_wheel_process (CoWheel *wheel,
+                  gint64   tick)
+{
+  GQueue *slot;
+  GList *link;
+  gint level;
+
+  wheel->tick = tick;
+
+  for (level = CO_WHEEL_LEVELS - 1; level > 0; level--)
+    {
+      if (tick & ((G_GINT64_CONSTANT (1) << CO_WHEEL_SHIFT (level)) - 1))
+        continue;
+
+      slot = &wheel->slots[level][CO_WHEEL_INDEX (tick, level)];
+      while ((link = g_queue_pop_head_link (slot)))
+        {
+          wheel->counts[level]--;
+          co_wheel_insert (wheel, link->data);
+        }
+    }
+
+  slot = &wheel->slots[0][CO_WHEEL_INDEX (tick, 0)];
+  while ((link = g_queue_pop_head_link (slot)))
+    {
+      CoTimer *timer = link->data;
+
+      wheel->counts[0]--;
+      timer->level = CO_WHEEL_LEVELS;
+      timer->queue = &wheel->expired;
+      g_queue_push_tail_link (timer->queue, link);
+    }
+}
+
+static gboolean
+co_wheel_dispatch (GSource     *source,
+                   GSourceFunc  callback,
+                   gpointer     user_data)
+{
+  CoWheel *wheel = (CoWheel *)source;
+  gint64 now = co_wheel_now ();
+  gint64 next;
+  GList *link;
+
+  while ((next = co_wheel_next (wheel)) != -1 && next <= now)
+    co_wheel_process (wheel, next);
+  wheel->tick = now;
+  co_wheel_arm (wheel, next);
+
+  /* the resumed coroutines may sleep again, or remove the timers
+   * still expired if another one resumes them first */
+  while ((link = g_queue_pop_head_link (&wheel->expired)))
+    {
+      CoTimer *timer = link->data;
+
+      timer->queue = NULL;
+      timer->fired = TRUE;
+      g_coroutine_resume (timer->co, NULL);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs co_wheel_funcs = {
+  NULL,
+  NULL,
+  co_wheel_dispatch,
+  NULL
+};
+
+static CoWheel *
+co_wheel_get (void)
+{
+  CoWheel *wheel = g_private_get (&co_wheel_key);
+  GSource *source;
+  gint level, i;
+
+  if (G_UNLIKELY (wheel == NULL))
+    {
+      source = g_source_new (&co_wheel_funcs, sizeof (CoWheel));
+      g_source_set_name (source, "GCoroutine timers");
+      wheel = (CoWheel *)source;
+      wheel->tick = co_wheel_now ();
+      wheel->next = -1;
+      for (level = 0; level < CO_WHEEL_LEVELS; level++)
+        for (i = 0; i < CO_WHEEL_SLOTS; i++)
+          g_queue_init (&wheel->slots[level][i]);
+      g_queue_init (&wheel->expired);
+      g_source_attach (source, g_main_context_get_thread_default ());
+      g_private_set (&co_wheel_key, wheel);
+    }
+
+  return wheel;
+}
+
+/**
+ * g_co_sleep_until:
+ * @end_time: the monotonic time to sleep until
+ *
+ * Suspends the current coroutine until @end_time, in the same time
+ * base as g_get_monotonic_time(), rounded up to the next millisecond.
+ * The coroutine is resumed from the thread-default main context of
+ * the first coroutine of this thread that went to sleep.
+ *
+ * If the coroutine is resumed by other means before @end_time, its
+ * timer is removed and %FALSE is returned. This is the case when it is
+ * cancelled with g_coroutine_cancel(), and once cancelled, it no
+ * longer sleeps at all.
+ *
+ * Returns: %TRUE if @end_time was reached
+ **/
+gboolean
+g_co_sleep_until (gint64 end_time) G_COROUTINE_FUNC
+{
+  CoWheel *wheel;
+  CoTimer timer = { { 0, } };
+  gint64 at;
+
+  g_return_val_if_fail (g_in_coroutine (), FALSE);
+
+  timer.co = g_coroutine_self ();
+  if (timer.co->cancelled)
+    return FALSE;
+
+  wheel = co_wheel_get ();
+
+  /* a wheel without timers is not kept up to date */
+  if (wheel->next == -1 && g_queue_is_empty (&wheel->expired))
+    wheel->tick = co_wheel_now ();
+
+  timer.link.data = &timer;
+  timer.expires = MAX ((end_time + 999) / 1000, wheel->tick + 1);
+
+  at = co_wheel_insert (wheel, &timer);
+  if (wheel->next == -1 || at < wheel->next)
+    co_wheel_arm (wheel, at);
+
+  timer.co->cancellable = TRUE;
+  g_coroutine_yield (NULL);
+  timer.co->cancellable = FALSE;
+
+  if (!timer.fired)
+    co_wheel_remove (wheel, &timer);
+
+  return timer.fired;
+}
+
+/**
+ * g_co_sleep:
+ * @usec: the number of microseconds to sleep
+ *
+ * Suspends the current coroutine for @usec microseconds, see
+ * g_co_sleep_until().
+ *
+ * Returns: %TRUE if the whole duration elapsed
+ **/
+gboolean
+g_co_sleep (gint64 usec) G_COROUTINE_FUNC
+{
+  return g_co_sleep_until (g_get_monotonic_time () + usec);
+}
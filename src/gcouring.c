@@ -0,0 +1,533 @@
+/*
+ * GLib coroutine io_uring engine
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "gcoroutineprivate.h"
+
+/**
+ * SECTION:gcouring
+ * @title: io_uring
+ * @short_description: asynchronous system calls from coroutines
+ * @see_also: g_co_wait_fd()
+ *
+ * On Linux, g_co_read(), g_co_write(), g_co_accept(), g_co_connect()
+ * and g_co_fsync() let a coroutine perform a system call through
+ * io_uring with the same straight-line code as a blocking call: the
+ * operation is queued on the submission ring of the current thread,
+ * and the coroutine yields %NULL to its caller until the operation
+ * completes.
+ *
+ * Nothing is submitted to the kernel until g_co_uring_iteration() is
+ * called. It submits all the operations queued since the previous
+ * iteration, by any coroutine of the thread, reaps the completions and
+ * resumes their coroutines, with a single system call. When the
+ * completions are already there and nothing was queued, no system call
+ * is made at all.
+ *
+ * The functions return like the system calls they replace: on failure,
+ * they return -1 and set errno. When io_uring cannot be set up, for
+ * instance because the kernel is too old or io_uring is disabled, they
+ * fail with the error of io_uring_setup(), usually %ENOSYS or %EPERM.
+ *
+ * The engine is only available when %GCOROUTINE_HAS_IO_URING is 1.
+ */
+
+#define CO_URING_ENTRIES 256
+
+typedef struct {
+  GCoroutine   *co;
+  gint          res;
+  gboolean      done;
+} CoUringOp;
+
+typedef struct {
+  gint                  fd;
+  guint                 queued;         /* not submitted yet */
+  guint                 inflight;       /* not completed yet */
+
+  guint                *sq_head;
+  guint                *sq_tail;
+  guint                 sq_mask;
+  guint                 sq_entries;
+  guint                *sq_array;
+  struct io_uring_sqe  *sqes;
+
+  guint                *cq_head;
+  guint                *cq_tail;
+  guint                 cq_mask;
+  struct io_uring_cqe  *cqes;
+
+  gpointer              sq_ring;
+  gsize                 sq_ring_size;
+  gpointer              cq_ring;
+  gsize                 cq_ring_size;
+  gsize                 sqes_size;
+
+  GPtrArray            *ready;          /* coroutines to resume */
+} CoUring;
+
+static void
+co_uring_free (CoUring *ring)
+{
+  g_warn_if_fail (ring->inflight == 0);
+
+  if (ring->sqes != NULL)
+    munmap (ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    munmap (ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring != NULL)
+    munmap (ring->sq_ring, ring->sq_ring_size);
+  if (ring->fd >= 0)
+    close (ring->fd);
+  if (ring->ready != NULL)
+    g_ptr_array_unref (ring->ready);
+  g_slice_free (CoUring, ring);
+}
+
+static GPrivate co_uring_key = G_PRIVATE_INIT ((GDestroyNotify) co_uring_free);
+
+/* errno of a setup failure that trying again would not fix */
+static gint co_uring_setup_errno;
+
+static gpointer
+co_uring_map (gint  fd,
+              gsize size,
+              off_t offset)
+{
+  gpointer ptr = mmap (NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, offset);
+
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/* Returns the ring of the current thread, or %NULL with errno set if
+ * io_uring is not available */
+static CoUring *
+co_uring_get (void)
+{
+  CoUring *ring = g_private_get (&co_uring_key);
+  struct io_uring_params p;
+  guint8 *sq, *cq;
+  gint errsv;
+
+  if (G_LIKELY (ring != NULL))
+    return ring;
+
+  errsv = g_atomic_int_get (&co_uring_setup_errno);
+  if (errsv != 0)
+    {
+      errno = errsv;
+      return NULL;
+    }
+
+  memset (&p, 0, sizeof (p));
+  ring = g_slice_new0 (CoUring);
+  ring->fd = syscall (__NR_io_uring_setup, CO_URING_ENTRIES, &p);
+  if (ring->fd < 0)
+    {
+      errsv = errno;
+      /* too old a kernel, or disabled by a sysctl or seccomp */
+      if (errsv == ENOSYS || errsv == EPERM)
+        g_atomic_int_set (&co_uring_setup_errno, errsv);
+      goto fail;
+    }
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (guint);
+  ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring->sq_ring_size = ring->cq_ring_size = MAX (ring->sq_ring_size,
+                                                   ring->cq_ring_size);
+
+  ring->sq_ring = co_uring_map (ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == NULL)
+    goto fail_errno;
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring->cq_ring = ring->sq_ring;
+  else
+    ring->cq_ring = co_uring_map (ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+  if (ring->cq_ring == NULL)
+    goto fail_errno;
+  ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  ring->sqes = co_uring_map (ring->fd, ring->sqes_size, IORING_OFF_SQES);
+  if (ring->sqes == NULL)
+    goto fail_errno;
+
+  sq = ring->sq_ring;
+  ring->sq_head = (guint *)(sq + p.sq_off.head);
+  ring->sq_tail = (guint *)(sq + p.sq_off.tail);
+  ring->sq_mask = *(guint *)(sq + p.sq_off.ring_mask);
+  ring->sq_entries = p.sq_entries;
+  ring->sq_array = (guint *)(sq + p.sq_off.array);
+
+  cq = ring->cq_ring;
+  ring->cq_head = (guint *)(cq + p.cq_off.head);
+  ring->cq_tail = (guint *)(cq + p.cq_off.tail);
+  ring->cq_mask = *(guint *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  g_private_set (&co_uring_key, ring);
+
+  return ring;
+
+fail_errno:
+  errsv = errno;
+fail:
+  co_uring_free (ring);
+  errno = errsv;
+
+  return NULL;
+}
+
+/* Submits the queued operations, and waits for @wait completions.
+ * Returns the number of operations submitted, or -1 with errno set. */
+static gint
+co_uring_enter (CoUring *ring,
+                guint    wait)
+{
+  gint n;
+
+  do
+    n = syscall (__NR_io_uring_enter, ring->fd, ring->queued, wait,
+                 wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  while (n < 0 && errno == EINTR);
+
+  if (n < 0)
+    return -1;
+
+  ring->queued -= n;
+
+  return n;
+}
+
+/* Returns a zeroed submission entry of the ring of the current thread,
+ * stored in @ring_out, or %NULL with errno set */
+static struct io_uring_sqe *
+co_uring_get_sqe (CoUring **ring_out)
+{
+  CoUring *ring = co_uring_get ();
+  struct io_uring_sqe *sqe;
+  guint tail, index;
+
+  if (ring == NULL)
+    return NULL;
+
+  /* the ring is full of operations from this tick: submit them now,
+   * the kernel may take fewer of them than asked */
+  tail = *ring->sq_tail;
+  while (tail - (guint) g_atomic_int_get ((gint *)ring->sq_head) == ring->sq_entries)
+    {
+      gint n = co_uring_enter (ring, 0);
+
+      if (n < 0)
+        return NULL;
+      if (n == 0)
+        {
+          /* the completion queue is full until the next iteration */
+          errno = EBUSY;
+          return NULL;
+        }
+    }
+
+  *ring_out = ring;
+  index = tail & ring->sq_mask;
+  sqe = &ring->sqes[index];
+  memset (sqe, 0, sizeof (*sqe));
+  ring->sq_array[index] = index;
+
+  return sqe;
+}
+
+/* Publishes @sqe, and yields until its completion */
+static gint
+co_uring_wait (CoUring             *ring,
+               struct io_uring_sqe *sqe) G_COROUTINE_FUNC
+{
+  CoUringOp op;
+
+  op.co = g_coroutine_self ();
+  op.res = 0;
+  op.done = FALSE;
+  sqe->user_data = (guintptr) &op;
+
+  g_atomic_int_set ((gint *)ring->sq_tail, *ring->sq_tail + 1);
+  ring->queued++;
+  ring->inflight++;
+
+  while (!op.done)
+    g_coroutine_yield (NULL);
+
+  if (op.res < 0)
+    {
+      errno = -op.res;
+      return -1;
+    }
+
+  return op.res;
+}
+
+/**
+ * g_co_read:
+ * @fd: a file descriptor
+ * @buf: the buffer to read into
+ * @count: the size of @buf
+ * @offset: the offset in the file to read from, or -1 to read from
+ *     the current position
+ *
+ * Reads up to @count bytes from @fd like pread(), or read() if
+ * @offset is -1, yielding until the read completes.
+ *
+ * Returns: the number of bytes read, or -1 on error
+ **/
+gssize
+g_co_read (gint      fd,
+           gpointer  buf,
+           gsize     count,
+           gint64    offset) G_COROUTINE_FUNC
+{
+  CoUring *ring;
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (g_in_coroutine (), -1);
+
+  sqe = co_uring_get_sqe (&ring);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (guintptr) buf;
+  sqe->len = MIN (count, G_MAXUINT32);
+  sqe->off = offset;
+
+  return co_uring_wait (ring, sqe);
+}
+
+/**
+ * g_co_write:
+ * @fd: a file descriptor
+ * @buf: the data to write
+ * @count: the size of @buf
+ * @offset: the offset in the file to write to, or -1 to write at the
+ *     current position
+ *
+ * Writes up to @count bytes to @fd like pwrite(), or write() if
+ * @offset is -1, yielding until the write completes.
+ *
+ * Returns: the number of bytes written, or -1 on error
+ **/
+gssize
+g_co_write (gint          fd,
+            gconstpointer buf,
+            gsize         count,
+            gint64        offset) G_COROUTINE_FUNC
+{
+  CoUring *ring;
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (g_in_coroutine (), -1);
+
+  sqe = co_uring_get_sqe (&ring);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (guintptr) buf;
+  sqe->len = MIN (count, G_MAXUINT32);
+  sqe->off = offset;
+
+  return co_uring_wait (ring, sqe);
+}
+
+/**
+ * g_co_accept:
+ * @fd: a listening socket
+ * @addr: (nullable): a struct sockaddr to store the peer address in
+ * @addrlen: (nullable) (inout): the size of @addr
+ *
+ * Accepts a connection on @fd like accept4() with %SOCK_CLOEXEC,
+ * yielding until a connection arrives.
+ *
+ * Returns: the connected socket, or -1 on error
+ **/
+gint
+g_co_accept (gint      fd,
+             gpointer  addr,
+             guint    *addrlen) G_COROUTINE_FUNC
+{
+  CoUring *ring;
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (g_in_coroutine (), -1);
+
+  sqe = co_uring_get_sqe (&ring);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->addr = (guintptr) addr;
+  sqe->addr2 = (guintptr) addrlen;
+  sqe->accept_flags = SOCK_CLOEXEC;
+
+  return co_uring_wait (ring, sqe);
+}
+
+/**
+ * g_co_connect:
+ * @fd: a socket
+ * @addr: the struct sockaddr to connect to
+ * @addrlen: the size of @addr
+ *
+ * Connects @fd like connect(), yielding until the connection is
+ * established.
+ *
+ * Returns: 0 on success, or -1 on error
+ **/
+gint
+g_co_connect (gint          fd,
+              gconstpointer addr,
+              guint         addrlen) G_COROUTINE_FUNC
+{
+  CoUring *ring;
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (g_in_coroutine (), -1);
+
+  sqe = co_uring_get_sqe (&ring);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_CONNECT;
+  sqe->fd = fd;
+  sqe->addr = (guintptr) addr;
+  sqe->off = addrlen;
+
+  return co_uring_wait (ring, sqe);
+}
+
+/**
+ * g_co_fsync:
+ * @fd: a file descriptor
+ *
+ * Flushes @fd to storage like fsync(), yielding until it is done.
+ *
+ * Returns: 0 on success, or -1 on error
+ **/
+gint
+g_co_fsync (gint fd) G_COROUTINE_FUNC
+{
+  CoUring *ring;
+  struct io_uring_sqe *sqe;
+
+  g_return_val_if_fail (g_in_coroutine (), -1);
+
+  sqe = co_uring_get_sqe (&ring);
+  if (sqe == NULL)
+    return -1;
+
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->fd = fd;
+
+  return co_uring_wait (ring, sqe);
+}
+
+/**
+ * g_co_uring_iteration:
+ * @may_block: whether the call may block
+ *
+ * Submits the operations queued by the coroutines of the current
+ * thread, and resumes the coroutines whose operations completed. If
+ * @may_block is %TRUE and no operation completed yet, waits for one.
+ * It does nothing if no operation was queued on this thread, and so
+ * when io_uring is not available.
+ *
+ * Returns: %TRUE if some coroutines were resumed
+ **/
+gboolean
+g_co_uring_iteration (gboolean may_block)
+{
+  CoUring *ring = g_private_get (&co_uring_key);
+  GPtrArray *ready;
+  guint head, tail, i, n;
+
+  /* no operation was ever queued on this thread */
+  if (ring == NULL)
+    return FALSE;
+
+  head = *ring->cq_head;
+  tail = g_atomic_int_get ((gint *)ring->cq_tail);
+
+  if (ring->queued > 0 || (head == tail && may_block && ring->inflight > 0))
+    {
+      if (co_uring_enter (ring, head == tail && may_block && ring->inflight > 0) < 0)
+        g_warning ("io_uring_enter: %s", g_strerror (errno));
+      tail = g_atomic_int_get ((gint *)ring->cq_tail);
+    }
+
+  if (head == tail)
+    return FALSE;
+
+  /* the operations are gone as soon as their coroutines run, and a
+   * resumed coroutine may run an iteration of its own */
+  ready = ring->ready;
+  ring->ready = NULL;
+  if (ready == NULL)
+    ready = g_ptr_array_new ();
+
+  for (; head != tail; head++)
+    {
+      struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+      CoUringOp *op = (CoUringOp *)(guintptr) cqe->user_data;
+
+      op->res = cqe->res;
+      op->done = TRUE;
+      g_ptr_array_add (ready, g_coroutine_ref (op->co));
+    }
+  g_atomic_int_set ((gint *)ring->cq_head, head);
+
+  n = ready->len;
+  ring->inflight -= n;
+  for (i = 0; i < n; i++)
+    {
+      GCoroutine *co = g_ptr_array_index (ready, i);
+
+      if (!co->terminated && g_coroutine_resumable (co))
+        g_coroutine_resume (co, NULL);
+      g_coroutine_unref (co);
+    }
+
+  g_ptr_array_set_size (ready, 0);
+  if (ring->ready == NULL)
+    ring->ready = ready;
+  else
+    g_ptr_array_unref (ready);
+
+  return TRUE;
+}
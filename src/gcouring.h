@@ -0,0 +1,58 @@
+/*
+ * GLib coroutine io_uring engine
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __G_CO_URING_H__
+#define __G_CO_URING_H__
+
+#if !defined(GCOROUTINE_H_INSIDE) && !defined(GCOROUTINE_COMPILATION)
+#error "Only gcoroutine.h can be included directly."
+#endif
+
+G_BEGIN_DECLS
+
+#if GCOROUTINE_HAS_IO_URING
+
+GCOROUTINE_AVAILABLE_IN_1_0
+gssize                 g_co_read                 (gint           fd,
+                                                  gpointer       buf,
+                                                  gsize          count,
+                                                  gint64         offset) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gssize                 g_co_write                (gint           fd,
+                                                  gconstpointer  buf,
+                                                  gsize          count,
+                                                  gint64         offset) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gint                   g_co_accept               (gint           fd,
+                                                  gpointer       addr,
+                                                  guint         *addrlen) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gint                   g_co_connect              (gint           fd,
+                                                  gconstpointer  addr,
+                                                  guint          addrlen) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gint                   g_co_fsync                (gint           fd) G_COROUTINE_FUNC;
+GCOROUTINE_AVAILABLE_IN_1_0
+gboolean               g_co_uring_iteration      (gboolean       may_block);
+
+#endif /* GCOROUTINE_HAS_IO_URING */
+
+G_END_DECLS
+
+#endif /* __G_CO_URING_H__ */
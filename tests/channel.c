@@ -0,0 +1,430 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <gcoroutine.h>
+
+typedef struct {
+  GCoChannel *channel;
+  guint       n_items;
+  guint       batch;
+  guint       received;
+  gboolean    done;
+} PipeData;
+
+static gpointer
+produce (gpointer data) G_COROUTINE_FUNC
+{
+  PipeData *pd = data;
+  gpointer items[64];
+  guint i, j;
+
+  g_assert_cmpuint (pd->batch, <=, G_N_ELEMENTS (items));
+
+  for (i = 0; i < pd->n_items; i += pd->batch)
+    {
+      guint n = MIN (pd->batch, pd->n_items - i);
+
+      if (pd->batch == 1)
+        {
+          g_assert (g_co_channel_send (pd->channel, GUINT_TO_POINTER (i)));
+          continue;
+        }
+
+      for (j = 0; j < n; j++)
+        items[j] = GUINT_TO_POINTER (i + j);
+      g_assert_cmpuint (g_co_channel_send_many (pd->channel, items, n), ==, n);
+    }
+
+  g_co_channel_close (pd->channel);
+
+  return NULL;
+}
+
+static gpointer
+consume (gpointer data) G_COROUTINE_FUNC
+{
+  PipeData *pd = data;
+  gpointer items[64];
+  guint i, n;
+
+  if (pd->batch == 1)
+    {
+      gpointer item;
+
+      while (g_co_channel_receive (pd->channel, &item))
+        {
+          g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, pd->received);
+          pd->received++;
+        }
+    }
+  else
+    {
+      while ((n = g_co_channel_receive_many (pd->channel, items, pd->batch)) > 0)
+        {
+          for (i = 0; i < n; i++)
+            g_assert_cmpuint (GPOINTER_TO_UINT (items[i]), ==, pd->received + i);
+          pd->received += n;
+        }
+    }
+
+  pd->done = TRUE;
+
+  return NULL;
+}
+
+static void
+pipe_run (PipeData *pd)
+{
+  GCoroutine *producer, *consumer;
+
+  consumer = g_coroutine_new (consume);
+  g_coroutine_resume (consumer, pd);
+
+  producer = g_coroutine_new (produce);
+  g_coroutine_resume (producer, pd);
+
+  g_coroutine_unref (producer);
+  g_coroutine_unref (consumer);
+}
+
+static void
+test_pipe (void)
+{
+  guint batches[] = { 1, 3, 16 };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (batches); i++)
+    {
+      PipeData pd = { g_co_channel_new (4), 100, batches[i], 0, FALSE };
+
+      pipe_run (&pd);
+      g_assert (pd.done);
+      g_assert_cmpuint (pd.received, ==, pd.n_items);
+      g_assert (g_co_channel_is_closed (pd.channel));
+      g_co_channel_unref (pd.channel);
+    }
+}
+
+static gpointer
+send_blocked (gpointer data) G_COROUTINE_FUNC
+{
+  GCoChannel *channel = data;
+
+  g_assert (g_co_channel_send (channel, GINT_TO_POINTER (1)));
+  g_assert (g_co_channel_send (channel, GINT_TO_POINTER (2)));
+  /* blocks until the channel is closed */
+  g_assert (!g_co_channel_send (channel, GINT_TO_POINTER (3)));
+
+  return NULL;
+}
+
+static gpointer
+close_channel (gpointer data) G_COROUTINE_FUNC
+{
+  g_co_channel_close (data);
+
+  return NULL;
+}
+
+static void
+test_close (void)
+{
+  GCoChannel *channel = g_co_channel_new (2);
+  GCoroutine *sender, *closer;
+  gpointer item;
+
+  sender = g_coroutine_new (send_blocked);
+  g_coroutine_resume (sender, channel);
+  g_assert_cmpuint (g_co_channel_get_length (channel), ==, 2);
+  g_assert (!g_co_channel_try_send (channel, NULL));
+
+  closer = g_coroutine_new (close_channel);
+  g_coroutine_resume (closer, channel);
+  g_coroutine_unref (closer);
+  g_assert (g_co_channel_is_closed (channel));
+
+  /* the items sent before closing can still be received */
+  g_assert (g_co_channel_try_receive (channel, &item));
+  g_assert_cmpint (GPOINTER_TO_INT (item), ==, 1);
+  g_assert (g_co_channel_try_receive (channel, &item));
+  g_assert_cmpint (GPOINTER_TO_INT (item), ==, 2);
+  g_assert (!g_co_channel_try_receive (channel, &item));
+
+  g_coroutine_unref (sender);
+  g_co_channel_unref (channel);
+}
+
+typedef struct {
+  GCoChannel *channel;
+  guint       n_items;
+  gboolean    done;
+} OutsideData;
+
+static gpointer
+receive_all (gpointer data) G_COROUTINE_FUNC
+{
+  OutsideData *od = data;
+  gpointer item;
+
+  while (g_co_channel_receive (od->channel, &item))
+    g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, ++od->n_items);
+  od->done = TRUE;
+
+  return NULL;
+}
+
+static gpointer
+send_all (gpointer data) G_COROUTINE_FUNC
+{
+  OutsideData *od = data;
+
+  while (g_co_channel_send (od->channel, GUINT_TO_POINTER (od->n_items + 1)))
+    od->n_items++;
+  od->done = TRUE;
+
+  return NULL;
+}
+
+static void
+test_outside (void)
+{
+  OutsideData od = { g_co_channel_new (2), 0, FALSE };
+  GCoroutine *co;
+  gpointer item;
+
+  /* outside of a coroutine, the waiters are resumed right away */
+  co = g_coroutine_new (receive_all);
+  g_coroutine_resume (co, &od);
+  g_assert (g_co_channel_try_send (od.channel, GUINT_TO_POINTER (1)));
+  g_assert (g_co_channel_try_send (od.channel, GUINT_TO_POINTER (2)));
+  g_assert_cmpuint (g_co_channel_get_length (od.channel), ==, 0);
+  g_assert_cmpuint (od.n_items, ==, 2);
+
+  g_co_channel_close (od.channel);
+  g_assert (od.done);
+  g_coroutine_unref (co);
+  g_co_channel_unref (od.channel);
+
+  od.channel = g_co_channel_new (2);
+  od.n_items = 0;
+  od.done = FALSE;
+  co = g_coroutine_new (send_all);
+  g_coroutine_resume (co, &od);
+  g_assert_cmpuint (od.n_items, ==, 2);
+  g_assert (g_co_channel_try_receive (od.channel, &item));
+  g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, 1);
+  g_assert_cmpuint (od.n_items, ==, 3);
+  g_assert_cmpuint (g_co_channel_get_length (od.channel), ==, 2);
+
+  g_co_channel_close (od.channel);
+  g_assert (od.done);
+  g_coroutine_unref (co);
+  g_co_channel_unref (od.channel);
+}
+
+static void
+test_try (void)
+{
+  GCoChannel *channel = g_co_channel_new (3);
+  gpointer item;
+  guint i;
+
+  /* wrap around the ring a few times */
+  for (i = 0; i < 10; i++)
+    {
+      g_assert (g_co_channel_try_send (channel, GUINT_TO_POINTER (i)));
+      g_assert (g_co_channel_try_send (channel, GUINT_TO_POINTER (i + 1)));
+      g_assert (g_co_channel_try_receive (channel, &item));
+      g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, i);
+      g_assert (g_co_channel_try_receive (channel, &item));
+      g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, i + 1);
+    }
+
+  for (i = 0; i < 3; i++)
+    g_assert (g_co_channel_try_send (channel, NULL));
+  g_assert (!g_co_channel_try_send (channel, NULL));
+  g_assert_cmpuint (g_co_channel_get_length (channel), ==, 3);
+
+  g_co_channel_unref (channel);
+}
+
+typedef struct {
+  GCoChannel *channels[2];
+  GString    *received;
+} SelectData;
+
+static gpointer
+receive_any (gpointer data) G_COROUTINE_FUNC
+{
+  SelectData *sd = data;
+  gpointer item;
+  gint index;
+
+  while ((index = g_co_channel_receive_any (sd->channels, 2, &item)) != -1)
+    g_string_append_printf (sd->received, "%d:%d ", index, GPOINTER_TO_INT (item));
+
+  return NULL;
+}
+
+static gpointer
+send_select (gpointer data) G_COROUTINE_FUNC
+{
+  SelectData *sd = data;
+
+  g_co_channel_send (sd->channels[1], GINT_TO_POINTER (1));
+  g_co_channel_send (sd->channels[0], GINT_TO_POINTER (2));
+  g_co_channel_close (sd->channels[0]);
+  g_co_channel_close (sd->channels[1]);
+
+  return NULL;
+}
+
+static void
+test_select (void)
+{
+  GCoroutine *receiver, *sender;
+  SelectData sd;
+
+  sd.channels[0] = g_co_channel_new (1);
+  sd.channels[1] = g_co_channel_new (1);
+  sd.received = g_string_new (NULL);
+
+  receiver = g_coroutine_new (receive_any);
+  g_coroutine_resume (receiver, &sd);
+  g_assert_cmpstr (sd.received->str, ==, "");
+
+  sender = g_coroutine_new (send_select);
+  g_coroutine_resume (sender, &sd);
+  g_assert_cmpstr (sd.received->str, ==, "1:1 0:2 ");
+
+  g_coroutine_unref (sender);
+  g_coroutine_unref (receiver);
+  g_string_free (sd.received, TRUE);
+  g_co_channel_unref (sd.channels[0]);
+  g_co_channel_unref (sd.channels[1]);
+}
+
+/*
+ * Throughput benchmark, against a GQueue guarded by two GCoQueue
+ */
+
+typedef struct {
+  GQueue   items;
+  guint    capacity;
+  gboolean closed;
+  GCoQueue not_full;
+  GCoQueue not_empty;
+  guint    n_items;
+  guint    received;
+} ManualData;
+
+static gpointer
+manual_produce (gpointer data) G_COROUTINE_FUNC
+{
+  ManualData *md = data;
+  guint i;
+
+  for (i = 0; i < md->n_items; i++)
+    {
+      while (md->items.length == md->capacity)
+        g_co_queue_yield (&md->not_full, NULL);
+      g_queue_push_tail (&md->items, GUINT_TO_POINTER (i));
+      g_co_queue_schedule (&md->not_empty, 1);
+    }
+
+  md->closed = TRUE;
+  g_co_queue_schedule (&md->not_empty, -1);
+
+  return NULL;
+}
+
+static gpointer
+manual_consume (gpointer data) G_COROUTINE_FUNC
+{
+  ManualData *md = data;
+
+  while (TRUE)
+    {
+      while (g_queue_is_empty (&md->items) && !md->closed)
+        g_co_queue_yield (&md->not_empty, NULL);
+      if (g_queue_is_empty (&md->items))
+        break;
+      g_assert_cmpuint (GPOINTER_TO_UINT (g_queue_pop_head (&md->items)), ==, md->received);
+      md->received++;
+      g_co_queue_schedule (&md->not_full, 1);
+    }
+
+  return NULL;
+}
+
+static void
+perf_throughput (void)
+{
+  const guint n_items = 100000, capacity = 64;
+  guint batches[] = { 1, 64 };
+  GCoroutine *producer, *consumer;
+  ManualData md = { G_QUEUE_INIT, capacity, FALSE, };
+  gdouble duration;
+  guint i;
+
+  g_co_queue_init (&md.not_full);
+  g_co_queue_init (&md.not_empty);
+  md.n_items = n_items;
+  md.received = 0;
+
+  g_test_timer_start ();
+  consumer = g_coroutine_new (manual_consume);
+  g_coroutine_resume (consumer, &md);
+  producer = g_coroutine_new (manual_produce);
+  g_coroutine_resume (producer, &md);
+  duration = g_test_timer_elapsed ();
+  g_assert_cmpuint (md.received, ==, n_items);
+  g_coroutine_unref (producer);
+  g_coroutine_unref (consumer);
+
+  g_test_message ("GQueue+GCoQueue %u items: %f s\n", n_items, duration);
+
+  for (i = 0; i < G_N_ELEMENTS (batches); i++)
+    {
+      PipeData pd = { g_co_channel_new (capacity), n_items, batches[i], 0, FALSE };
+
+      g_test_timer_start ();
+      pipe_run (&pd);
+      duration = g_test_timer_elapsed ();
+      g_assert_cmpuint (pd.received, ==, n_items);
+      g_co_channel_unref (pd.channel);
+
+      g_test_message ("GCoChannel %u items, batches of %u: %f s\n",
+                      n_items, batches[i], duration);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/channel/pipe", test_pipe);
+  g_test_add_func ("/channel/close", test_close);
+  g_test_add_func ("/channel/try", test_try);
+  g_test_add_func ("/channel/outside", test_outside);
+  g_test_add_func ("/channel/select", test_select);
+  if (g_test_perf ())
+    g_test_add_func ("/perf/throughput", perf_throughput);
+
+  return g_test_run ();
+}
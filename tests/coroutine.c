@@ -20,6 +20,7 @@
  */
 #include <glib.h>
 #include <gcoroutine.h>
+#include <string.h>
 
 /*
  * Check that g_in_coroutine() works
@@ -164,6 +165,52 @@ test_yield (void)
   g_coroutine_unref (coroutine);
 }
 
+/*
+ * Check that several values can be exchanged at once
+ */
+
+static gpointer
+sum_values (gpointer data) G_COROUTINE_FUNC
+{
+  const GCoValue *in = data;
+  GCoValue out[2];
+
+  while (in[0].v_pointer != NULL)
+    {
+      out[0].v_size = in[1].v_size + in[2].v_uint;
+      out[1].v_pointer = in[0].v_pointer;
+      in = g_coroutine_yield_values (out, G_N_ELEMENTS (out));
+    }
+
+  /* not returned by g_coroutine_resume_values() */
+  return (gpointer) in;
+}
+
+static void
+test_yield_values (void)
+{
+  GCoroutine *coroutine;
+  const GCoValue *ret;
+  GCoValue in[3];
+  gsize i;
+
+  coroutine = g_coroutine_new (sum_values);
+
+  for (i = 0; i < 10; i++)
+    {
+      in[0].v_pointer = &in;
+      in[1].v_size = i;
+      in[2].v_uint = 100;
+      ret = g_coroutine_resume_values (coroutine, in, G_N_ELEMENTS (in));
+      g_assert_cmpuint (ret[0].v_size, ==, i + 100);
+      g_assert (ret[1].v_pointer == &in);
+    }
+
+  in[0].v_pointer = NULL;
+  g_assert (g_coroutine_resume_values (coroutine, in, 1) == NULL);
+  g_coroutine_unref (coroutine);
+}
+
 /*
  * Check that creation, enter, and return work
  */
@@ -230,6 +277,355 @@ test_unref (void)
     g_assert (done);
 }
 
+/*
+ * Check that coroutines can live in caller-provided storage
+ */
+
+static void
+test_static (void)
+{
+  static guint8 stack[64 * 1024];
+  GCoroutineStorage storage;
+  GCoroutine *coroutine;
+  gboolean done = FALSE;
+  gint i = 0;
+
+  coroutine = g_coroutine_init_static (&storage, stack, sizeof (stack),
+                                       yield_5_times);
+  g_assert ((gpointer)coroutine == (gpointer)&storage);
+
+  while (!done)
+    {
+      g_assert (g_coroutine_resumable (coroutine));
+      g_assert_cmpint (GPOINTER_TO_INT (g_coroutine_resume (coroutine, &done)), ==, i);
+      i++;
+    }
+  g_assert_cmpint (i, ==, 6);
+  g_coroutine_unref (coroutine);
+
+  /* storage and stack can be reused once the coroutine is gone */
+  done = FALSE;
+  coroutine = g_coroutine_init_static (&storage, stack, sizeof (stack),
+                                       set_and_exit);
+  g_coroutine_resume (coroutine, &done);
+  g_assert (done);
+  g_coroutine_unref (coroutine);
+}
+
+/*
+ * Check that coroutines created in a batch are independent
+ */
+
+static void
+test_batch (void)
+{
+  GCoroutine *coroutines[16];
+  gboolean done[G_N_ELEMENTS (coroutines)] = { FALSE, };
+  guint i;
+
+  g_coroutine_new_batch (yield_done, G_N_ELEMENTS (coroutines), coroutines);
+
+  for (i = 0; i < G_N_ELEMENTS (coroutines); i++)
+    {
+      g_assert (g_coroutine_resumable (coroutines[i]));
+      g_coroutine_resume (coroutines[i], &done[i]);
+    }
+
+  /* release in a different order than creation */
+  for (i = G_N_ELEMENTS (coroutines); i > 0; i--)
+    {
+      g_assert (!done[i - 1]);
+      g_coroutine_resume (coroutines[i - 1], NULL);
+      g_assert (done[i - 1]);
+      g_coroutine_unref (coroutines[i - 1]);
+    }
+}
+
+/*
+ * Check that coroutine-local values follow their coroutine
+ */
+
+static void
+count_destroy (gpointer data)
+{
+  gint *count = data;
+
+  (*count)++;
+}
+
+static GCoPrivate private_key = G_CO_PRIVATE_INIT (count_destroy);
+
+static gpointer
+private_set_yield (gpointer data) G_COROUTINE_FUNC
+{
+  g_assert (g_co_private_get (&private_key) == NULL);
+  g_co_private_set (&private_key, data);
+  g_coroutine_yield (NULL);
+  g_assert (g_co_private_get (&private_key) == data);
+
+  return NULL;
+}
+
+static void
+test_private (void)
+{
+  GCoroutine *c1, *c2;
+  gint count1 = 0, count2 = 0;
+
+  g_co_private_set (&private_key, NULL);
+
+  c1 = g_coroutine_new (private_set_yield);
+  c2 = g_coroutine_new (private_set_yield);
+  g_coroutine_resume (c1, &count1);
+  g_coroutine_resume (c2, &count2);
+  g_assert (g_co_private_get (&private_key) == NULL);
+
+  /* notifier runs on termination */
+  g_coroutine_resume (c1, NULL);
+  g_assert_cmpint (count1, ==, 1);
+  g_assert_cmpint (count2, ==, 0);
+  g_coroutine_unref (c1);
+
+  g_coroutine_resume (c2, NULL);
+  g_assert_cmpint (count2, ==, 1);
+  g_coroutine_unref (c2);
+
+  g_assert (g_co_private_get (&private_key) == NULL);
+}
+
+/*
+ * Check that coroutine allocations are usable until termination
+ */
+
+static gpointer
+alloc_many (gpointer data) G_COROUTINE_FUNC
+{
+  guint8 *blocks[200];
+  guint8 *big;
+  guint i;
+
+  g_assert (g_coroutine_alloc (0) == NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (blocks); i++)
+    {
+      blocks[i] = g_coroutine_alloc (i + 1);
+      g_assert_cmpuint (GPOINTER_TO_SIZE (blocks[i]) % sizeof (gpointer), ==, 0);
+      memset (blocks[i], i, i + 1);
+    }
+
+  big = g_coroutine_alloc0 (64 * 1024);
+  g_assert_cmpint (big[64 * 1024 - 1], ==, 0);
+  g_coroutine_yield (NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (blocks); i++)
+    {
+      g_assert_cmpint (blocks[i][0], ==, (guint8) i);
+      g_assert_cmpint (blocks[i][i], ==, (guint8) i);
+    }
+
+  return NULL;
+}
+
+static void
+test_alloc (void)
+{
+  GCoroutine *coroutine;
+
+  coroutine = g_coroutine_new (alloc_many);
+  g_coroutine_resume (coroutine, NULL);
+  g_coroutine_resume (coroutine, NULL);
+  g_coroutine_unref (coroutine);
+}
+
+typedef struct {
+  GCoroutine **c;
+  guint        n;
+  GString     *order;
+  GThread     *thread;
+} WakeupData;
+
+static gpointer
+co_wakeup_wait (gpointer data) G_COROUTINE_FUNC
+{
+  WakeupData *wd = data;
+  guint i = GPOINTER_TO_UINT (g_coroutine_yield (NULL));
+
+  g_coroutine_yield (NULL);
+  wd->thread = g_thread_self ();
+  if (wd->order)
+    g_string_append_printf (wd->order, "%u", i);
+  wd->n--;
+
+  return NULL;
+}
+
+static gpointer
+wakeup_thread (gpointer data)
+{
+  WakeupData *wd = data;
+  guint i, n = wd->n;
+
+  for (i = 0; i < n; i++)
+    g_coroutine_wakeup (wd->c[i]);
+
+  return NULL;
+}
+
+static void
+test_wakeup (void)
+{
+  GCoroutine *c[3];
+  WakeupData wd = { c, G_N_ELEMENTS (c), NULL, NULL };
+  GThread *thread;
+  guint i;
+
+  wd.order = g_string_new (NULL);
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    {
+      c[i] = g_coroutine_new (co_wakeup_wait);
+      g_coroutine_resume (c[i], &wd);
+      g_coroutine_resume (c[i], GUINT_TO_POINTER (i));
+    }
+
+  /* resumed in the creating thread, in the order of the wakeups */
+  thread = g_thread_new ("wakeup", wakeup_thread, &wd);
+  while (wd.n > 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_thread_join (thread);
+
+  g_assert_cmpstr (wd.order->str, ==, "012");
+  g_assert (wd.thread == g_thread_self ());
+  g_assert (!g_main_context_pending (NULL));
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+  g_string_free (wd.order, TRUE);
+}
+
+static gpointer
+co_return_after_yield (gpointer data) G_COROUTINE_FUNC
+{
+  g_coroutine_yield (NULL);
+
+  return data;
+}
+
+static gpointer
+co_join (gpointer data) G_COROUTINE_FUNC
+{
+  gpointer *result = g_coroutine_yield (NULL);
+
+  *result = g_coroutine_join (data);
+
+  return NULL;
+}
+
+static void
+test_join (void)
+{
+  GCoroutine *target, *joiner;
+  gpointer result = NULL;
+
+  target = g_coroutine_new (co_return_after_yield);
+  g_coroutine_resume (target, "value");
+
+  joiner = g_coroutine_new (co_join);
+  g_coroutine_resume (joiner, target);
+  g_coroutine_resume (joiner, &result);
+  g_assert (result == NULL);
+
+  /* resumed only when the target terminates */
+  g_coroutine_resume (target, NULL);
+  g_assert_cmpstr (result, ==, "value");
+  g_coroutine_unref (joiner);
+
+  /* already terminated */
+  result = NULL;
+  joiner = g_coroutine_new (co_join);
+  g_coroutine_resume (joiner, target);
+  g_coroutine_resume (joiner, &result);
+  g_assert_cmpstr (result, ==, "value");
+  g_coroutine_unref (joiner);
+
+  g_coroutine_unref (target);
+}
+
+/* a GIO-like asynchronous addition, completed from an idle */
+typedef void (*AddReadyCallback) (gpointer source, gpointer result, gpointer user_data);
+
+typedef struct {
+  AddReadyCallback callback;
+  gpointer         user_data;
+  gint             sum;
+} AddAsync;
+
+static gboolean
+add_async_complete (gpointer data)
+{
+  AddAsync *op = data;
+
+  op->callback (NULL, op, op->user_data);
+  g_free (op);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+add_async (gint             a,
+           gint             b,
+           AddReadyCallback callback,
+           gpointer         user_data)
+{
+  AddAsync *op = g_new (AddAsync, 1);
+
+  op->callback = callback;
+  op->user_data = user_data;
+  op->sum = a + b;
+  g_idle_add (add_async_complete, op);
+}
+
+static gint
+add_finish (gpointer result)
+{
+  return ((AddAsync *)result)->sum;
+}
+
+static gpointer
+co_async (gpointer data) G_COROUTINE_FUNC
+{
+  gint i, sum = 0;
+
+  for (i = 1; i <= 3; i++)
+    {
+      add_async (sum, i, g_co_async_ready, g_coroutine_self ());
+      sum = add_finish (g_co_async_yield ());
+    }
+
+  *(gint *)data = sum;
+
+  return NULL;
+}
+
+static void
+test_async (void)
+{
+  GCoroutine *c = g_coroutine_new (co_async);
+  gint sum = 0;
+
+  g_coroutine_resume (c, &sum);
+
+  /* resumed before the operation completed, it keeps waiting */
+  g_coroutine_resume (c, NULL);
+  g_assert_cmpint (sum, ==, 0);
+
+  while (sum == 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpint (sum, ==, 6);
+  g_assert (!g_main_context_pending (NULL));
+
+  g_coroutine_unref (c);
+}
+
 /*
  * Lifecycle benchmark
  */
@@ -261,6 +657,47 @@ perf_lifecycle (void)
   g_test_message ("Lifecycle %u iterations: %f s\n", max, duration);
 }
 
+static void
+perf_lifecycle_batch (void)
+{
+  GCoroutine *c[32];
+  guint i, j, max;
+  gdouble duration;
+
+  max = 1000000 / G_N_ELEMENTS (c);
+
+  g_test_timer_start ();
+  for (i = 0; i < max; i++)
+    {
+      for (j = 0; j < G_N_ELEMENTS (c); j++)
+        c[j] = g_coroutine_new (empty_coroutine);
+      for (j = 0; j < G_N_ELEMENTS (c); j++)
+        {
+          g_coroutine_resume (c[j], NULL);
+          g_coroutine_unref (c[j]);
+        }
+    }
+  duration = g_test_timer_elapsed ();
+
+  g_test_message ("Lifecycle %u bursts of %u: %f s\n",
+                  max, (guint) G_N_ELEMENTS (c), duration);
+
+  g_test_timer_start ();
+  for (i = 0; i < max; i++)
+    {
+      g_coroutine_new_batch (empty_coroutine, G_N_ELEMENTS (c), c);
+      for (j = 0; j < G_N_ELEMENTS (c); j++)
+        {
+          g_coroutine_resume (c[j], NULL);
+          g_coroutine_unref (c[j]);
+        }
+    }
+  duration = g_test_timer_elapsed ();
+
+  g_test_message ("Lifecycle %u batches of %u: %f s\n",
+                  max, (guint) G_N_ELEMENTS (c), duration);
+}
+
 static void
 perf_nesting (void)
 {
@@ -414,66 +851,1016 @@ test_mutex (void)
   g_coroutine_unref (first);
 }
 
+typedef struct {
+  GCoMutex mutex;
+  GString *order;
+} RelockData;
+
 static gpointer
-co_wlock (gpointer data) G_COROUTINE_FUNC
+co_relock (gpointer data) G_COROUTINE_FUNC
 {
-    gint *seq = data;
-    GCoRWLock *lock = g_coroutine_yield (NULL);;
+  RelockData *rd = data;
 
-    g_co_rw_lock_writer_lock (lock);
-    (*seq)++;
-    g_coroutine_yield (NULL);
-    g_co_rw_lock_writer_unlock (lock);
-    (*seq)++;
+  g_co_mutex_lock (&rd->mutex);
+  g_coroutine_yield (NULL);
+  g_co_mutex_unlock (&rd->mutex);
+  /* try to take it again before the waiter had a chance to run */
+  g_co_mutex_lock (&rd->mutex);
+  g_string_append_c (rd->order, 'a');
+  g_co_mutex_unlock (&rd->mutex);
 
-    return NULL;
+  return NULL;
 }
 
 static gpointer
-co_rlock (gpointer data) G_COROUTINE_FUNC
+co_lock_wait (gpointer data) G_COROUTINE_FUNC
 {
-    gint *seq = data;
-    GCoRWLock *lock = g_coroutine_yield (NULL);;
+  RelockData *rd = data;
 
-    g_co_rw_lock_reader_lock (lock);
-    (*seq)++;
-    g_coroutine_yield (NULL);
-    g_co_rw_lock_reader_unlock (lock);
-    (*seq)++;
+  g_co_mutex_lock (&rd->mutex);
+  g_string_append_c (rd->order, 'b');
+  g_co_mutex_unlock (&rd->mutex);
 
-    return NULL;
+  return NULL;
 }
 
 static void
-test_rwlock (void)
+relock (GCoMutexFlags flags, const gchar *expected)
 {
-    GCoroutine *wlock, *rlock1, *rlock2;
-    GCoRWLock lock;
-    gint seq = 0;
-
-    g_co_rw_lock_init (&lock);
+  GCoroutine *a, *b;
+  RelockData rd;
 
-    /* writer locks */
-    wlock = g_coroutine_new (co_wlock);
-    g_coroutine_resume (wlock, &seq);
-    g_coroutine_resume (wlock, &lock);
-    g_assert_cmpint (seq, ==, 1);
+  g_co_mutex_init_full (&rd.mutex, flags);
+  rd.order = g_string_new (NULL);
 
-    /* readers waiting */
-    rlock1 = g_coroutine_new (co_rlock);
-    g_coroutine_resume (rlock1, &seq);
-    g_coroutine_resume (rlock1, &lock);
+  a = g_coroutine_new (co_relock);
+  g_coroutine_resume (a, &rd);
+  b = g_coroutine_new (co_lock_wait);
+  g_coroutine_resume (b, &rd);
+  g_coroutine_resume (a, NULL);
 
-    rlock2 = g_coroutine_new (co_rlock);
-    g_coroutine_resume (rlock2, &seq);
-    g_coroutine_resume (rlock2, &lock);
-    g_assert_cmpint (seq, ==, 1);
+  g_assert_cmpstr (rd.order->str, ==, expected);
+  g_assert (!rd.mutex.locked);
 
-    /* writer release lock */
-    g_coroutine_resume (wlock, NULL);
-    /* readers continue */
-    g_assert_cmpint (seq, ==, 4);
-    g_coroutine_unref (wlock);
+  g_coroutine_unref (b);
+  g_coroutine_unref (a);
+  g_string_free (rd.order, TRUE);
+}
+
+static void
+test_mutex_fair (void)
+{
+  /* the default mutex lets the unlocker take it back, the fair mutex
+   * hands it over to the waiter */
+  relock (G_CO_MUTEX_DEFAULT, "ab");
+  relock (G_CO_MUTEX_FAIR, "ba");
+}
+
+static void
+test_mutex_fair_resumed (void)
+{
+  GCoroutine *a, *b;
+  RelockData rd;
+
+  g_co_mutex_init_full (&rd.mutex, G_CO_MUTEX_FAIR);
+  rd.order = g_string_new (NULL);
+
+  a = g_coroutine_new (co_relock);
+  g_coroutine_resume (a, &rd);
+  b = g_coroutine_new (co_lock_wait);
+  g_coroutine_resume (b, &rd);
+
+  /* resumed by something else than the unlock, the waiter waits again */
+  g_coroutine_resume (b, NULL);
+  g_assert_cmpstr (rd.order->str, ==, "");
+  g_assert (rd.mutex.locked);
+
+  g_coroutine_resume (a, NULL);
+  g_assert_cmpstr (rd.order->str, ==, "ba");
+  g_assert (!rd.mutex.locked);
+
+  g_coroutine_unref (b);
+  g_coroutine_unref (a);
+  g_string_free (rd.order, TRUE);
+}
+
+typedef struct {
+  GCoMutex mutex;
+  guint    count;
+  guint    held;
+} SharedData;
+
+#define SHARED_THREADS 4
+#define SHARED_COROUTINES 4
+#define SHARED_ROUNDS 2000
+
+static gpointer
+co_lock_shared (gpointer data) G_COROUTINE_FUNC
+{
+  SharedData *sd = data;
+  guint i;
+
+  for (i = 0; i < SHARED_ROUNDS; i++)
+    {
+      g_co_mutex_lock (&sd->mutex);
+      g_assert_cmpuint (sd->held++, ==, 0);
+      sd->count++;
+      sd->held--;
+      g_co_mutex_unlock (&sd->mutex);
+    }
+
+  return NULL;
+}
+
+static gpointer
+lock_shared_thread (gpointer data)
+{
+  GMainContext *context = g_main_context_new ();
+  GCoroutine *c[SHARED_COROUTINES];
+  guint i, running;
+
+  /* the coroutines parked on the mutex are resumed from here */
+  g_main_context_push_thread_default (context);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    {
+      c[i] = g_coroutine_new (co_lock_shared);
+      g_coroutine_resume (c[i], data);
+    }
+
+  do
+    {
+      for (i = 0, running = 0; i < G_N_ELEMENTS (c); i++)
+        running += g_coroutine_resumable (c[i]);
+      if (running)
+        g_main_context_iteration (context, TRUE);
+    }
+  while (running);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+
+  g_main_context_pop_thread_default (context);
+  g_main_context_unref (context);
+
+  return NULL;
+}
+
+static void
+test_mutex_thread_safe (void)
+{
+  GThread *threads[SHARED_THREADS];
+  SharedData sd;
+  guint i;
+
+  g_co_mutex_init_full (&sd.mutex, G_CO_MUTEX_THREAD_SAFE);
+  sd.count = sd.held = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++)
+    threads[i] = g_thread_new ("lock", lock_shared_thread, &sd);
+  for (i = 0; i < G_N_ELEMENTS (threads); i++)
+    g_thread_join (threads[i]);
+
+  g_assert_cmpuint (sd.count, ==,
+                    SHARED_THREADS * SHARED_COROUTINES * SHARED_ROUNDS);
+  g_assert (!sd.mutex.locked);
+  g_assert (g_co_queue_is_empty (&sd.mutex.queue));
+}
+
+/*
+ * Contended mutex benchmark
+ */
+
+typedef struct {
+  GCoMutex *mutex;
+  guint     rounds;
+  guint     max_wait;
+  gboolean  waiting[8];
+} ContendData;
+
+static gpointer
+co_contend (gpointer data) G_COROUTINE_FUNC
+{
+  ContendData *cd = g_coroutine_yield (NULL);
+  guint id = GPOINTER_TO_UINT (data);
+  guint i;
+
+  for (i = 0; i < 10000; i++)
+    {
+      guint start = cd->rounds;
+
+      cd->waiting[id] = TRUE;
+      g_co_mutex_lock (cd->mutex);
+      cd->waiting[id] = FALSE;
+      cd->max_wait = MAX (cd->max_wait, cd->rounds - start);
+      g_coroutine_yield (NULL);
+      g_co_mutex_unlock (cd->mutex);
+    }
+
+  return NULL;
+}
+
+static void
+contend (GCoMutexFlags flags, const gchar *name)
+{
+  GCoroutine *c[8];
+  GCoMutex mutex;
+  ContendData cd = { &mutex, 0, 0, { FALSE, } };
+  gboolean running = TRUE;
+  gdouble duration;
+  guint i;
+
+  g_co_mutex_init_full (&mutex, flags);
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    {
+      c[i] = g_coroutine_new (co_contend);
+      g_coroutine_resume (c[i], GUINT_TO_POINTER (i));
+    }
+
+  g_test_timer_start ();
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_resume (c[i], &cd);
+
+  while (running)
+    {
+      running = FALSE;
+      cd.rounds++;
+      for (i = 0; i < G_N_ELEMENTS (c); i++)
+        {
+          /* waiters are resumed by the mutex */
+          if (!g_coroutine_resumable (c[i]) || cd.waiting[i])
+            continue;
+          g_coroutine_resume (c[i], NULL);
+          running = TRUE;
+        }
+    }
+  duration = g_test_timer_elapsed ();
+
+  g_test_message ("Contended %s mutex, %u coroutines: %u rounds, "
+                  "max wait %u rounds, %f s\n", name,
+                  (guint) G_N_ELEMENTS (c), cd.rounds, cd.max_wait, duration);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+}
+
+static void
+perf_wakeup (void)
+{
+  GCoroutine *c[10000];
+  WakeupData wd = { c, G_N_ELEMENTS (c), NULL, NULL };
+  GThread *thread;
+  gdouble duration;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    {
+      c[i] = g_coroutine_new (co_wakeup_wait);
+      g_coroutine_resume (c[i], &wd);
+      g_coroutine_resume (c[i], GUINT_TO_POINTER (i));
+    }
+
+  g_test_timer_start ();
+  thread = g_thread_new ("wakeup", wakeup_thread, &wd);
+  while (wd.n > 0)
+    g_main_context_iteration (NULL, TRUE);
+  duration = g_test_timer_elapsed ();
+  g_thread_join (thread);
+
+  g_test_message ("Wakeup %u coroutines from another thread: %f s\n",
+                  (guint) G_N_ELEMENTS (c), duration);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+}
+
+static void
+perf_mutex (void)
+{
+  contend (G_CO_MUTEX_DEFAULT, "default");
+  contend (G_CO_MUTEX_FAIR, "fair");
+}
+
+typedef struct {
+  GCoMutex mutex;
+  GCoCond  cond;
+  gboolean ready;
+  guint    woken;
+} CondData;
+
+static gpointer
+co_cond_wait (gpointer data) G_COROUTINE_FUNC
+{
+  CondData *cd = data;
+
+  g_co_mutex_lock (&cd->mutex);
+  while (!cd->ready)
+    g_co_cond_wait (&cd->cond, &cd->mutex);
+  g_assert (cd->mutex.locked);
+  cd->woken++;
+  g_co_mutex_unlock (&cd->mutex);
+
+  return NULL;
+}
+
+static gpointer
+co_cond_broadcast (gpointer data) G_COROUTINE_FUNC
+{
+  CondData *cd = data;
+
+  g_co_mutex_lock (&cd->mutex);
+  cd->ready = TRUE;
+  g_co_cond_broadcast (&cd->cond);
+  g_coroutine_yield (NULL);
+  g_co_mutex_unlock (&cd->mutex);
+
+  return NULL;
+}
+
+static void
+cond_broadcast (GCoMutexFlags flags)
+{
+  GCoroutine *waiters[3], *signaller;
+  CondData cd = { .ready = FALSE, .woken = 0 };
+  guint i;
+
+  g_co_mutex_init_full (&cd.mutex, flags);
+  g_co_cond_init (&cd.cond);
+
+  for (i = 0; i < G_N_ELEMENTS (waiters); i++)
+    {
+      waiters[i] = g_coroutine_new (co_cond_wait);
+      g_coroutine_resume (waiters[i], &cd);
+    }
+  g_assert (!cd.mutex.locked);
+
+  signaller = g_coroutine_new (co_cond_broadcast);
+  g_coroutine_resume (signaller, &cd);
+  /* the waiters wait for the mutex, not the condition */
+  g_assert_cmpint (cd.woken, ==, 0);
+
+  g_coroutine_resume (signaller, NULL);
+  g_assert_cmpint (cd.woken, ==, G_N_ELEMENTS (waiters));
+  g_assert (!cd.mutex.locked);
+
+  g_coroutine_unref (signaller);
+  for (i = 0; i < G_N_ELEMENTS (waiters); i++)
+    g_coroutine_unref (waiters[i]);
+}
+
+static gpointer
+co_cond_signal (gpointer data) G_COROUTINE_FUNC
+{
+  CondData *cd = data;
+
+  g_co_mutex_lock (&cd->mutex);
+  cd->ready = TRUE;
+  g_co_cond_signal (&cd->cond);
+  g_co_mutex_unlock (&cd->mutex);
+
+  return NULL;
+}
+
+static void
+test_cond (void)
+{
+  CondData cd = { .ready = FALSE, .woken = 0 };
+  GCoroutine *waiters[2], *signaller;
+  guint i;
+
+  g_co_mutex_init (&cd.mutex);
+  g_co_cond_init (&cd.cond);
+
+  for (i = 0; i < G_N_ELEMENTS (waiters); i++)
+    {
+      waiters[i] = g_coroutine_new (co_cond_wait);
+      g_coroutine_resume (waiters[i], &cd);
+    }
+
+  /* only one waiter is woken up */
+  signaller = g_coroutine_new (co_cond_signal);
+  g_coroutine_resume (signaller, &cd);
+  g_assert_cmpint (cd.woken, ==, 1);
+  g_coroutine_unref (signaller);
+
+  signaller = g_coroutine_new (co_cond_signal);
+  g_coroutine_resume (signaller, &cd);
+  g_assert_cmpint (cd.woken, ==, 2);
+  g_coroutine_unref (signaller);
+
+  for (i = 0; i < G_N_ELEMENTS (waiters); i++)
+    g_coroutine_unref (waiters[i]);
+
+  cond_broadcast (G_CO_MUTEX_DEFAULT);
+  cond_broadcast (G_CO_MUTEX_FAIR);
+}
+
+typedef struct {
+  GCoSemaphore sem;
+  GString *order;
+} SemData;
+
+static gpointer
+co_sem_acquire (gpointer data) G_COROUTINE_FUNC
+{
+  SemData *sd = data;
+  guint n = GPOINTER_TO_UINT (g_coroutine_yield (NULL));
+
+  g_co_semaphore_acquire (&sd->sem, n);
+  g_string_append_printf (sd->order, "%u", n);
+  g_coroutine_yield (NULL);
+  g_co_semaphore_release (&sd->sem, n);
+
+  return NULL;
+}
+
+static gpointer
+co_sem_release_one (gpointer data) G_COROUTINE_FUNC
+{
+  SemData *sd = data;
+
+  g_co_semaphore_release (&sd->sem, 1);
+
+  return NULL;
+}
+
+static void
+sem_release_one (SemData *sd)
+{
+  GCoroutine *c = g_coroutine_new (co_sem_release_one);
+
+  g_coroutine_resume (c, sd);
+  g_coroutine_unref (c);
+}
+
+static void
+test_semaphore (void)
+{
+  GCoroutine *c[2];
+  SemData sd;
+  guint i;
+
+  g_co_semaphore_init (&sd.sem, 2);
+  sd.order = g_string_new (NULL);
+
+  g_assert (g_co_semaphore_try_acquire (&sd.sem, 2));
+  g_assert (!g_co_semaphore_try_acquire (&sd.sem, 1));
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 0);
+
+  /* queue a waiter for 2 permits, then one for 1 permit */
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    {
+      c[i] = g_coroutine_new (co_sem_acquire);
+      g_coroutine_resume (c[i], &sd);
+      g_coroutine_resume (c[i], GUINT_TO_POINTER (2 - i));
+    }
+
+  /* one permit is not enough for the head, the second waits behind */
+  sem_release_one (&sd);
+  g_assert_cmpstr (sd.order->str, ==, "");
+  g_assert (!g_co_semaphore_try_acquire (&sd.sem, 1));
+
+  sem_release_one (&sd);
+  g_assert_cmpstr (sd.order->str, ==, "2");
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 0);
+
+  /* only the permits needed by the next waiter are taken */
+  g_coroutine_resume (c[0], NULL);
+  g_assert_cmpstr (sd.order->str, ==, "21");
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 1);
+
+  g_coroutine_resume (c[1], NULL);
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 2);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+
+  /* resumed by something else than a release, a waiter waits again */
+  c[0] = g_coroutine_new (co_sem_acquire);
+  g_coroutine_resume (c[0], &sd);
+  g_coroutine_resume (c[0], GUINT_TO_POINTER (3));
+  g_coroutine_resume (c[0], NULL);
+  g_assert_cmpstr (sd.order->str, ==, "21");
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 2);
+
+  sem_release_one (&sd);
+  g_assert_cmpstr (sd.order->str, ==, "213");
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 0);
+  g_coroutine_resume (c[0], NULL);
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 3);
+  g_coroutine_unref (c[0]);
+
+  g_string_free (sd.order, TRUE);
+}
+
+typedef struct {
+  GCoWaitGroup wg;
+  guint        done;
+} WaitGroupData;
+
+static gpointer
+co_wait_group_worker (gpointer data) G_COROUTINE_FUNC
+{
+  WaitGroupData *wd = data;
+
+  g_coroutine_yield (NULL);
+  wd->done++;
+  g_co_wait_group_done (&wd->wg);
+
+  return NULL;
+}
+
+static gpointer
+co_wait_group_wait (gpointer data) G_COROUTINE_FUNC
+{
+  WaitGroupData *wd = data;
+
+  g_co_wait_group_wait (&wd->wg);
+  g_assert_cmpuint (wd->done, ==, 3);
+
+  return GINT_TO_POINTER (TRUE);
+}
+
+static void
+test_wait_group (void)
+{
+  GCoroutine *workers[3], *waiter;
+  WaitGroupData wd;
+  guint i;
+
+  g_co_wait_group_init (&wd.wg);
+  wd.done = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (workers); i++)
+    {
+      g_co_wait_group_add (&wd.wg, 1);
+      workers[i] = g_coroutine_new (co_wait_group_worker);
+      g_coroutine_resume (workers[i], &wd);
+    }
+
+  waiter = g_coroutine_new (co_wait_group_wait);
+  g_assert (g_coroutine_resume (waiter, &wd) == NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (workers); i++)
+    {
+      g_assert (g_coroutine_resumable (waiter));
+      g_coroutine_resume (workers[i], NULL);
+      g_coroutine_unref (workers[i]);
+
+      /* resumed while the count is not zero, the waiter waits again */
+      if (i == 0)
+        g_assert (g_coroutine_resume (waiter, NULL) == NULL);
+    }
+  g_assert_cmpuint (wd.done, ==, 3);
+  g_assert (g_co_queue_is_empty (&wd.wg.queue));
+
+  /* nothing to wait for */
+  g_coroutine_unref (waiter);
+  waiter = g_coroutine_new (co_wait_group_wait);
+  g_assert (g_coroutine_resume (waiter, &wd) == GINT_TO_POINTER (TRUE));
+  g_coroutine_unref (waiter);
+}
+
+typedef struct {
+  GCoQueue queues[3];
+  gint index;
+} SelectData;
+
+static gpointer
+co_select (gpointer data) G_COROUTINE_FUNC
+{
+  SelectData *sd = data;
+  GCoQueue *queues[] = { &sd->queues[0], &sd->queues[1], &sd->queues[2] };
+
+  sd->index = g_co_queue_select (queues, G_N_ELEMENTS (queues), NULL);
+
+  return NULL;
+}
+
+static gpointer
+co_schedule_all (gpointer data) G_COROUTINE_FUNC
+{
+  return GINT_TO_POINTER (g_co_queue_schedule (data, -1));
+}
+
+static gint
+schedule_all (GCoQueue *queue)
+{
+  GCoroutine *c = g_coroutine_new (co_schedule_all);
+  gint n = GPOINTER_TO_INT (g_coroutine_resume (c, queue));
+
+  g_coroutine_unref (c);
+
+  return n;
+}
+
+static void
+test_select (void)
+{
+  GCoroutine *c;
+  SelectData sd;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sd.queues); i++)
+    g_co_queue_init (&sd.queues[i]);
+
+  /* woken by the second queue, and removed from the others */
+  sd.index = -2;
+  c = g_coroutine_new (co_select);
+  g_coroutine_resume (c, &sd);
+  for (i = 0; i < G_N_ELEMENTS (sd.queues); i++)
+    g_assert (!g_co_queue_is_empty (&sd.queues[i]));
+
+  g_assert_cmpint (schedule_all (&sd.queues[1]), ==, 1);
+  g_assert_cmpint (sd.index, ==, 1);
+  for (i = 0; i < G_N_ELEMENTS (sd.queues); i++)
+    g_assert (g_co_queue_is_empty (&sd.queues[i]));
+  g_assert_cmpint (schedule_all (&sd.queues[0]), ==, 0);
+  g_coroutine_unref (c);
+
+  /* resumed directly, without being scheduled */
+  sd.index = -2;
+  c = g_coroutine_new (co_select);
+  g_coroutine_resume (c, &sd);
+  g_coroutine_resume (c, NULL);
+  g_assert_cmpint (sd.index, ==, -1);
+  for (i = 0; i < G_N_ELEMENTS (sd.queues); i++)
+    g_assert (g_co_queue_is_empty (&sd.queues[i]));
+  g_coroutine_unref (c);
+}
+
+typedef struct {
+  GCoMutex  mutex;
+  GCoRWLock rwlock;
+  gint64    end_time;
+  gint      result;
+  gint      readers;
+} TimedData;
+
+static gpointer
+co_hold_mutex (gpointer data) G_COROUTINE_FUNC
+{
+  TimedData *td = data;
+
+  g_co_mutex_lock (&td->mutex);
+  g_coroutine_yield (NULL);
+  g_co_mutex_unlock (&td->mutex);
+
+  return NULL;
+}
+
+static gpointer
+co_mutex_lock_timed (gpointer data) G_COROUTINE_FUNC
+{
+  TimedData *td = data;
+
+  td->result = g_co_mutex_lock_timed (&td->mutex, td->end_time);
+  if (td->result)
+    g_co_mutex_unlock (&td->mutex);
+
+  return NULL;
+}
+
+static gpointer
+co_hold_reader (gpointer data) G_COROUTINE_FUNC
+{
+  TimedData *td = data;
+
+  g_co_rw_lock_reader_lock (&td->rwlock);
+  td->readers++;
+  g_coroutine_yield (NULL);
+  g_co_rw_lock_reader_unlock (&td->rwlock);
+
+  return NULL;
+}
+
+static gpointer
+co_writer_lock_timed (gpointer data) G_COROUTINE_FUNC
+{
+  TimedData *td = data;
+
+  td->result = g_co_rw_lock_writer_lock_timed (&td->rwlock, td->end_time);
+  if (td->result)
+    g_co_rw_lock_writer_unlock (&td->rwlock);
+
+  return NULL;
+}
+
+static void
+timed_wait (TimedData *td, GCoroutineFunc func, gint64 timeout)
+{
+  GCoroutine *c = g_coroutine_new (func);
+
+  td->result = -1;
+  td->end_time = g_get_monotonic_time () + timeout;
+  g_coroutine_resume (c, td);
+  g_coroutine_unref (c);
+}
+
+static void
+test_timed (void)
+{
+  GCoroutine *holder, *reader;
+  TimedData td;
+
+  g_co_mutex_init (&td.mutex);
+  g_co_rw_lock_init_full (&td.rwlock, G_CO_RW_LOCK_PREFER_WRITER);
+  td.readers = 0;
+
+  /* expires while the mutex is held */
+  holder = g_coroutine_new (co_hold_mutex);
+  g_coroutine_resume (holder, &td);
+  timed_wait (&td, co_mutex_lock_timed, 10 * G_TIME_SPAN_MILLISECOND);
+  g_assert_cmpint (td.result, ==, -1);
+  while (td.result == -1)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpint (td.result, ==, FALSE);
+  g_assert_cmpint (g_get_monotonic_time (), >=, td.end_time);
+  g_assert (g_co_queue_is_empty (&td.mutex.queue));
+  g_coroutine_resume (holder, NULL);
+  g_coroutine_unref (holder);
+  g_assert (!td.mutex.locked);
+
+  /* granted before the deadline, the timer is removed */
+  holder = g_coroutine_new (co_hold_mutex);
+  g_coroutine_resume (holder, &td);
+  timed_wait (&td, co_mutex_lock_timed, G_TIME_SPAN_HOUR);
+  g_coroutine_resume (holder, NULL);
+  g_coroutine_unref (holder);
+  g_assert_cmpint (td.result, ==, TRUE);
+  g_assert (!td.mutex.locked);
+  g_assert (!g_main_context_pending (NULL));
+
+  /* a writer giving up lets the readers queued behind it in */
+  holder = g_coroutine_new (co_hold_reader);
+  g_coroutine_resume (holder, &td);
+  timed_wait (&td, co_writer_lock_timed, 10 * G_TIME_SPAN_MILLISECOND);
+  reader = g_coroutine_new (co_hold_reader);
+  g_coroutine_resume (reader, &td);
+  g_assert_cmpint (td.readers, ==, 1);
+  while (td.result == -1)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpint (td.result, ==, FALSE);
+  g_assert_cmpint (td.readers, ==, 2);
+  g_coroutine_resume (holder, NULL);
+  g_coroutine_resume (reader, NULL);
+  g_coroutine_unref (holder);
+  g_coroutine_unref (reader);
+  g_assert_cmpint (td.rwlock.reader, ==, 0);
+}
+
+typedef struct {
+  GCoQueue  queue;
+  GString  *order;
+} PriorityData;
+
+static gpointer
+co_wait_priority (gpointer data) G_COROUTINE_FUNC
+{
+  PriorityData *pd = data;
+
+  g_co_queue_yield (&pd->queue, NULL);
+  g_string_append_c (pd->order,
+                     "hdl"[g_coroutine_get_priority (g_coroutine_self ()) + 1]);
+
+  return NULL;
+}
+
+static void
+wait_priority (PriorityData *pd, GCoPriority priority)
+{
+  GCoroutine *c = g_coroutine_new (co_wait_priority);
+
+  g_coroutine_set_priority (c, priority);
+  g_coroutine_resume (c, pd);
+  g_coroutine_unref (c);
+}
+
+static void
+test_priority (void)
+{
+  PriorityData pd;
+  guint i;
+
+  g_co_queue_init (&pd.queue);
+  pd.order = g_string_new (NULL);
+
+  wait_priority (&pd, G_CO_PRIORITY_LOW);
+  wait_priority (&pd, G_CO_PRIORITY_DEFAULT);
+  wait_priority (&pd, G_CO_PRIORITY_HIGH);
+  wait_priority (&pd, G_CO_PRIORITY_DEFAULT);
+  g_assert_cmpint (schedule_all (&pd.queue), ==, 4);
+  g_assert_cmpstr (pd.order->str, ==, "hddl");
+
+  /* aging: the low priority waiter is passed over only so many times */
+  g_string_truncate (pd.order, 0);
+  wait_priority (&pd, G_CO_PRIORITY_LOW);
+  for (i = 0; i < G_CO_PRIORITY_AGING + 2; i++)
+    wait_priority (&pd, G_CO_PRIORITY_HIGH);
+  schedule_all (&pd.queue);
+  g_assert_cmpstr (pd.order->str, ==, "hhhhhhhhlhh");
+
+  g_string_free (pd.order, TRUE);
+}
+
+typedef struct {
+  GCoQueue     queue;
+  GCoMutex     mutex;
+  GCoCond      cond;
+  GString     *order;
+} CancelData;
+
+static gpointer
+co_cancel_queue (gpointer data) G_COROUTINE_FUNC
+{
+  CancelData *cd = data;
+
+  g_assert (g_co_queue_yield (&cd->queue, NULL) == NULL);
+  g_string_append_c (cd->order, 'q');
+
+  /* it does not block anymore */
+  g_assert (g_co_queue_yield (&cd->queue, NULL) == NULL);
+  g_assert (g_coroutine_is_cancelled (g_coroutine_self ()));
+
+  return NULL;
+}
+
+static gpointer
+co_cancel_hold (gpointer data) G_COROUTINE_FUNC
+{
+  CancelData *cd = data;
+
+  g_assert (g_co_mutex_lock (&cd->mutex));
+  g_coroutine_yield (NULL);
+  g_co_mutex_unlock (&cd->mutex);
+
+  return NULL;
+}
+
+static gpointer
+co_cancel_mutex (gpointer data) G_COROUTINE_FUNC
+{
+  CancelData *cd = data;
+
+  g_string_append_c (cd->order, g_co_mutex_lock (&cd->mutex) ? 'M' : 'm');
+
+  return NULL;
+}
+
+static gpointer
+co_cancel_cond (gpointer data) G_COROUTINE_FUNC
+{
+  CancelData *cd = data;
+
+  g_assert (g_co_mutex_lock (&cd->mutex));
+  g_string_append_c (cd->order, g_co_cond_wait (&cd->cond, &cd->mutex) ? 'C' : 'c');
+  g_assert (cd->mutex.locked);
+  g_co_mutex_unlock (&cd->mutex);
+
+  return NULL;
+}
+
+static gpointer
+co_cancel_sem (gpointer data) G_COROUTINE_FUNC
+{
+  SemData *sd = data;
+  guint n = GPOINTER_TO_UINT (g_coroutine_yield (NULL));
+
+  g_string_append_printf (sd->order, g_co_semaphore_acquire (&sd->sem, n) ?
+                          "%u" : "-%u", n);
+
+  return NULL;
+}
+
+static void
+test_cancel (void)
+{
+  CancelData cd;
+  SemData sd;
+  GCoroutine *holder, *c[2];
+  guint i;
+
+  g_co_queue_init (&cd.queue);
+  g_co_mutex_init (&cd.mutex);
+  g_co_cond_init (&cd.cond);
+  cd.order = g_string_new (NULL);
+
+  /* removed from the queue */
+  c[0] = g_coroutine_new (co_cancel_queue);
+  g_coroutine_resume (c[0], &cd);
+  g_coroutine_cancel (c[0]);
+  g_assert_cmpstr (cd.order->str, ==, "q");
+  g_assert (g_co_queue_is_empty (&cd.queue));
+  g_assert (!g_coroutine_resumable (c[0]));
+  g_coroutine_unref (c[0]);
+
+  /* gives up waiting for the mutex */
+  holder = g_coroutine_new (co_cancel_hold);
+  g_coroutine_resume (holder, &cd);
+  c[0] = g_coroutine_new (co_cancel_mutex);
+  g_coroutine_resume (c[0], &cd);
+  g_coroutine_cancel (c[0]);
+  g_assert_cmpstr (cd.order->str, ==, "qm");
+  g_assert (g_co_queue_is_empty (&cd.mutex.queue));
+  g_coroutine_resume (holder, NULL);
+  g_assert (!cd.mutex.locked);
+  g_coroutine_unref (c[0]);
+  g_coroutine_unref (holder);
+
+  /* stops waiting for the condition, but locks the mutex again */
+  c[0] = g_coroutine_new (co_cancel_cond);
+  g_coroutine_resume (c[0], &cd);
+  holder = g_coroutine_new (co_cancel_hold);
+  g_coroutine_resume (holder, &cd);
+  g_coroutine_cancel (c[0]);
+  g_assert_cmpstr (cd.order->str, ==, "qm");
+  g_coroutine_resume (holder, NULL);
+  g_assert_cmpstr (cd.order->str, ==, "qmc");
+  g_assert (!cd.mutex.locked);
+  g_coroutine_unref (c[0]);
+  g_coroutine_unref (holder);
+
+  g_string_free (cd.order, TRUE);
+
+  /* the permits go to the next waiter when the head is cancelled */
+  g_co_semaphore_init (&sd.sem, 0);
+  sd.order = g_string_new (NULL);
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    {
+      c[i] = g_coroutine_new (co_cancel_sem);
+      g_coroutine_resume (c[i], &sd);
+      g_coroutine_resume (c[i], GUINT_TO_POINTER (2 - i));
+    }
+  sem_release_one (&sd);
+  g_coroutine_cancel (c[0]);
+  g_assert_cmpstr (sd.order->str, ==, "-21");
+  g_assert_cmpuint (g_co_semaphore_get_value (&sd.sem), ==, 0);
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+
+  g_string_free (sd.order, TRUE);
+}
+
+static gpointer
+co_wlock (gpointer data) G_COROUTINE_FUNC
+{
+    gint *seq = data;
+    GCoRWLock *lock = g_coroutine_yield (NULL);;
+
+    g_co_rw_lock_writer_lock (lock);
+    (*seq)++;
+    g_coroutine_yield (NULL);
+    g_co_rw_lock_writer_unlock (lock);
+    (*seq)++;
+
+    return NULL;
+}
+
+static gpointer
+co_rlock (gpointer data) G_COROUTINE_FUNC
+{
+    gint *seq = data;
+    GCoRWLock *lock = g_coroutine_yield (NULL);;
+
+    g_co_rw_lock_reader_lock (lock);
+    (*seq)++;
+    g_coroutine_yield (NULL);
+    g_co_rw_lock_reader_unlock (lock);
+    (*seq)++;
+
+    return NULL;
+}
+
+static void
+test_rwlock (void)
+{
+    GCoroutine *wlock, *rlock1, *rlock2;
+    GCoRWLock lock;
+    gint seq = 0;
+
+    g_co_rw_lock_init (&lock);
+
+    /* writer locks */
+    wlock = g_coroutine_new (co_wlock);
+    g_coroutine_resume (wlock, &seq);
+    g_coroutine_resume (wlock, &lock);
+    g_assert_cmpint (seq, ==, 1);
+
+    /* readers waiting */
+    rlock1 = g_coroutine_new (co_rlock);
+    g_coroutine_resume (rlock1, &seq);
+    g_coroutine_resume (rlock1, &lock);
+
+    rlock2 = g_coroutine_new (co_rlock);
+    g_coroutine_resume (rlock2, &seq);
+    g_coroutine_resume (rlock2, &lock);
+    g_assert_cmpint (seq, ==, 1);
+
+    /* writer release lock */
+    g_coroutine_resume (wlock, NULL);
+    /* readers continue */
+    g_assert_cmpint (seq, ==, 4);
+    g_coroutine_unref (wlock);
 
     /* writer locks, waiting */
     wlock = g_coroutine_new (co_wlock);
@@ -493,6 +1880,184 @@ test_rwlock (void)
     g_coroutine_unref (wlock);
 }
 
+typedef struct {
+  GCoRWLock lock;
+  GString *order;
+} RWOrderData;
+
+static gpointer
+co_read_hold (gpointer data) G_COROUTINE_FUNC
+{
+  RWOrderData *d = data;
+
+  g_co_rw_lock_reader_lock (&d->lock);
+  g_string_append_c (d->order, 'r');
+  g_coroutine_yield (NULL);
+  g_co_rw_lock_reader_unlock (&d->lock);
+
+  return NULL;
+}
+
+static gpointer
+co_write_hold (gpointer data) G_COROUTINE_FUNC
+{
+  RWOrderData *d = data;
+
+  g_co_rw_lock_writer_lock (&d->lock);
+  g_string_append_c (d->order, 'w');
+  g_coroutine_yield (NULL);
+  g_co_rw_lock_writer_unlock (&d->lock);
+
+  return NULL;
+}
+
+static gpointer
+co_read (gpointer data) G_COROUTINE_FUNC
+{
+  RWOrderData *d = data;
+
+  g_co_rw_lock_reader_lock (&d->lock);
+  g_string_append_c (d->order, 'r');
+  g_co_rw_lock_reader_unlock (&d->lock);
+
+  return NULL;
+}
+
+static gpointer
+co_write (gpointer data) G_COROUTINE_FUNC
+{
+  RWOrderData *d = data;
+
+  g_co_rw_lock_writer_lock (&d->lock);
+  g_string_append_c (d->order, 'w');
+  g_co_rw_lock_writer_unlock (&d->lock);
+
+  return NULL;
+}
+
+static void
+rwlock_order (GCoRWLockPolicy  policy,
+              GCoroutineFunc   first,
+              GCoroutineFunc   second,
+              GCoroutineFunc   third,
+              const gchar     *expected)
+{
+  GCoroutine *c[3];
+  RWOrderData d;
+  guint i;
+
+  g_co_rw_lock_init_full (&d.lock, policy);
+  d.order = g_string_new (NULL);
+
+  c[0] = g_coroutine_new (first);
+  c[1] = g_coroutine_new (second);
+  c[2] = g_coroutine_new (third);
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_resume (c[i], &d);
+
+  /* the first one holds the lock until now */
+  g_coroutine_resume (c[0], NULL);
+  g_assert_cmpstr (d.order->str, ==, expected);
+  g_assert (!d.lock.writer);
+  g_assert_cmpint (d.lock.reader, ==, 0);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+  g_string_free (d.order, TRUE);
+}
+
+static void
+test_rwlock_policy (void)
+{
+  /* a reader arriving while a writer waits */
+  rwlock_order (G_CO_RW_LOCK_PREFER_READER,
+                co_read_hold, co_write, co_read, "rrw");
+  rwlock_order (G_CO_RW_LOCK_PREFER_WRITER,
+                co_read_hold, co_write, co_read, "rwr");
+  rwlock_order (G_CO_RW_LOCK_PHASE_FAIR,
+                co_read_hold, co_write, co_read, "rwr");
+
+  /* a reader and a writer waiting on a writer */
+  rwlock_order (G_CO_RW_LOCK_PREFER_READER,
+                co_write_hold, co_read, co_write, "wrw");
+  rwlock_order (G_CO_RW_LOCK_PREFER_WRITER,
+                co_write_hold, co_read, co_write, "wwr");
+  rwlock_order (G_CO_RW_LOCK_PHASE_FAIR,
+                co_write_hold, co_read, co_write, "wrw");
+}
+
+static gpointer
+co_read_twice (gpointer data) G_COROUTINE_FUNC
+{
+  RWOrderData *d = data;
+
+  g_co_rw_lock_reader_lock (&d->lock);
+  g_coroutine_yield (NULL);
+  g_co_rw_lock_reader_lock (&d->lock);
+  g_string_append_c (d->order, 'r');
+  g_co_rw_lock_reader_unlock (&d->lock);
+  g_co_rw_lock_reader_unlock (&d->lock);
+
+  return NULL;
+}
+
+static void
+test_rwlock_recursive (void)
+{
+  GCoroutine *reader, *writer;
+  RWOrderData d;
+
+  /* a writer waiting between two read locks does not block the second */
+  g_co_rw_lock_init (&d.lock);
+  d.order = g_string_new (NULL);
+
+  reader = g_coroutine_new (co_read_twice);
+  g_coroutine_resume (reader, &d);
+  writer = g_coroutine_new (co_write);
+  g_coroutine_resume (writer, &d);
+  g_coroutine_resume (reader, NULL);
+  g_assert_cmpstr (d.order->str, ==, "rw");
+  g_assert (!d.lock.writer);
+  g_assert_cmpint (d.lock.reader, ==, 0);
+
+  g_coroutine_unref (writer);
+  g_coroutine_unref (reader);
+  g_string_free (d.order, TRUE);
+}
+
+static void
+test_rwlock_resumed (void)
+{
+  GCoroutine *c[3];
+  RWOrderData d;
+  guint i;
+
+  g_co_rw_lock_init_full (&d.lock, G_CO_RW_LOCK_PREFER_WRITER);
+  d.order = g_string_new (NULL);
+
+  c[0] = g_coroutine_new (co_write_hold);
+  c[1] = g_coroutine_new (co_read);
+  c[2] = g_coroutine_new (co_write);
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_resume (c[i], &d);
+
+  /* resumed by something else than an unlock, the waiters wait again */
+  g_coroutine_resume (c[1], NULL);
+  g_coroutine_resume (c[2], NULL);
+  g_assert_cmpstr (d.order->str, ==, "w");
+  g_assert (d.lock.writer);
+  g_assert_cmpint (d.lock.reader, ==, 0);
+
+  g_coroutine_resume (c[0], NULL);
+  g_assert_cmpstr (d.order->str, ==, "wwr");
+  g_assert (!d.lock.writer);
+  g_assert_cmpint (d.lock.reader, ==, 0);
+
+  for (i = 0; i < G_N_ELEMENTS (c); i++)
+    g_coroutine_unref (c[i]);
+  g_string_free (d.order, TRUE);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -501,18 +2066,42 @@ main (int argc, char **argv)
   g_test_add_func ("/basic/lifecycle", test_lifecycle);
   g_test_add_func ("/basic/unref", test_unref);
   g_test_add_func ("/basic/yield", test_yield);
+  g_test_add_func ("/basic/yield-values", test_yield_values);
   g_test_add_func ("/basic/nesting", test_nesting);
   g_test_add_func ("/basic/self", test_self);
   g_test_add_func ("/basic/in_coroutine", test_in_coroutine);
+  g_test_add_func ("/basic/static", test_static);
+  g_test_add_func ("/basic/batch", test_batch);
+  g_test_add_func ("/basic/private", test_private);
+  g_test_add_func ("/basic/alloc", test_alloc);
+  g_test_add_func ("/basic/wakeup", test_wakeup);
+  g_test_add_func ("/basic/join", test_join);
+  g_test_add_func ("/basic/async", test_async);
   if (g_test_perf ())
     {
       g_test_add_func ("/perf/lifecycle", perf_lifecycle);
+      g_test_add_func ("/perf/lifecycle-batch", perf_lifecycle_batch);
       g_test_add_func ("/perf/nesting", perf_nesting);
       g_test_add_func ("/perf/yield", perf_yield);
+      g_test_add_func ("/perf/mutex", perf_mutex);
+      g_test_add_func ("/perf/wakeup", perf_wakeup);
     }
 
   g_test_add_func ("/lock/mutex", test_mutex);
+  g_test_add_func ("/lock/mutex-fair", test_mutex_fair);
+  g_test_add_func ("/lock/mutex-fair-resumed", test_mutex_fair_resumed);
+  g_test_add_func ("/lock/mutex-thread-safe", test_mutex_thread_safe);
+  g_test_add_func ("/lock/cond", test_cond);
+  g_test_add_func ("/lock/semaphore", test_semaphore);
+  g_test_add_func ("/lock/select", test_select);
+  g_test_add_func ("/lock/wait-group", test_wait_group);
+  g_test_add_func ("/lock/timed", test_timed);
+  g_test_add_func ("/lock/priority", test_priority);
+  g_test_add_func ("/lock/cancel", test_cancel);
   g_test_add_func ("/lock/rwlock", test_rwlock);
+  g_test_add_func ("/lock/rwlock-policy", test_rwlock_policy);
+  g_test_add_func ("/lock/rwlock-recursive", test_rwlock_recursive);
+  g_test_add_func ("/lock/rwlock-resumed", test_rwlock_resumed);
 
   return g_test_run ();
 }
@@ -0,0 +1,255 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <gcoroutine.h>
+#include <string.h>
+
+typedef struct {
+  GCoPool    *pool;
+  guint       rounds;
+  gboolean    slow;
+  gint        done;
+  gint        migrations;
+  GMutex      lock;
+  GHashTable *threads;
+} PoolData;
+
+static PoolData pd;
+
+static gpointer
+count_rounds (gpointer data) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GThread *thread = g_thread_self ();
+  guint i;
+
+  for (i = 0; i < pd.rounds; i++)
+    {
+      g_assert (g_coroutine_self () == self);
+
+      if (pd.slow)
+        {
+          g_mutex_lock (&pd.lock);
+          g_hash_table_add (pd.threads, g_thread_self ());
+          g_mutex_unlock (&pd.lock);
+          g_usleep (1000);
+        }
+      g_co_pool_yield ();
+
+      if (g_thread_self () != thread)
+        {
+          g_assert (g_coroutine_get_migratable (self));
+          g_atomic_int_inc (&pd.migrations);
+          thread = g_thread_self ();
+        }
+    }
+
+  g_atomic_int_inc (&pd.done);
+
+  return NULL;
+}
+
+static void
+pool_data_init (guint    rounds,
+                gboolean slow)
+{
+  memset (&pd, 0, sizeof (pd));
+  pd.rounds = rounds;
+  pd.slow = slow;
+  g_mutex_init (&pd.lock);
+  pd.threads = g_hash_table_new (NULL, NULL);
+}
+
+static void
+pool_data_clear (void)
+{
+  g_hash_table_unref (pd.threads);
+  g_mutex_clear (&pd.lock);
+}
+
+static void
+add_coroutines (guint    n,
+                gboolean migratable)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+    {
+      GCoroutine *co = g_coroutine_new (count_rounds);
+
+      g_coroutine_set_migratable (co, migratable);
+      g_co_pool_add (pd.pool, co, NULL);
+    }
+}
+
+static void
+test_run (void)
+{
+  pool_data_init (100, FALSE);
+  pd.pool = g_co_pool_new (4);
+  add_coroutines (100, TRUE);
+  add_coroutines (100, FALSE);
+
+  /* waits for all of them */
+  g_co_pool_free (pd.pool);
+  g_assert_cmpint (pd.done, ==, 200);
+
+  pool_data_clear ();
+}
+
+static void
+test_pinned (void)
+{
+  pool_data_init (20, TRUE);
+  pd.pool = g_co_pool_new (4);
+  add_coroutines (8, FALSE);
+  g_co_pool_free (pd.pool);
+
+  g_assert_cmpint (pd.done, ==, 8);
+  g_assert_cmpint (pd.migrations, ==, 0);
+
+  pool_data_clear ();
+}
+
+static gpointer
+fan_out (gpointer data) G_COROUTINE_FUNC
+{
+  /* the children are queued on the current worker */
+  add_coroutines (GPOINTER_TO_UINT (data), TRUE);
+
+  return NULL;
+}
+
+static void
+test_steal (void)
+{
+  GCoroutine *co = g_coroutine_new (fan_out);
+
+  pool_data_init (20, TRUE);
+  pd.pool = g_co_pool_new (4);
+  g_co_pool_add (pd.pool, co, GUINT_TO_POINTER (16));
+  g_co_pool_free (pd.pool);
+
+  g_assert_cmpint (pd.done, ==, 16);
+  g_assert_cmpuint (g_hash_table_size (pd.threads), >, 1);
+  g_test_message ("%d migrations over %u threads\n", pd.migrations,
+                  g_hash_table_size (pd.threads));
+
+  pool_data_clear ();
+}
+
+static GCoMutex shared_mutex;
+static guint shared_count;
+static guint shared_held;
+
+static gpointer
+lock_rounds (gpointer data) G_COROUTINE_FUNC
+{
+  GCoroutine *self = g_coroutine_self ();
+  GThread *thread = g_thread_self ();
+  guint i;
+
+  for (i = 0; i < pd.rounds; i++)
+    {
+      g_co_mutex_lock (&shared_mutex);
+      g_assert_cmpuint (shared_held++, ==, 0);
+      /* let the other coroutines contend for it */
+      g_usleep (100);
+      g_co_pool_yield ();
+      shared_count++;
+      shared_held--;
+      g_co_mutex_unlock (&shared_mutex);
+
+      /* woken up from the mutex on the same worker, unless migratable */
+      if (g_thread_self () != thread)
+        {
+          g_assert (g_coroutine_get_migratable (self));
+          g_atomic_int_inc (&pd.migrations);
+          thread = g_thread_self ();
+        }
+    }
+
+  g_atomic_int_inc (&pd.done);
+
+  return NULL;
+}
+
+static void
+test_mutex (void)
+{
+  guint i;
+
+  pool_data_init (50, FALSE);
+  g_co_mutex_init_full (&shared_mutex, G_CO_MUTEX_THREAD_SAFE);
+  shared_count = 0;
+  shared_held = 0;
+
+  pd.pool = g_co_pool_new (4);
+  for (i = 0; i < 8; i++)
+    {
+      GCoroutine *co = g_coroutine_new (lock_rounds);
+
+      g_coroutine_set_migratable (co, i % 2);
+      g_co_pool_add (pd.pool, co, NULL);
+    }
+
+  /* the parked coroutines are still part of the pool */
+  g_co_pool_free (pd.pool);
+  g_assert_cmpint (pd.done, ==, 8);
+  g_assert_cmpuint (shared_count, ==, 8 * pd.rounds);
+
+  pool_data_clear ();
+}
+
+/*
+ * Pool yield benchmark
+ */
+
+static void
+perf_pool (void)
+{
+  guint n_workers = g_get_num_processors ();
+  gdouble duration;
+
+  pool_data_init (10000, FALSE);
+  pd.pool = g_co_pool_new (n_workers);
+
+  g_test_timer_start ();
+  add_coroutines (1000, TRUE);
+  g_co_pool_free (pd.pool);
+  duration = g_test_timer_elapsed ();
+
+  g_test_message ("Pool of %u workers, %u yields: %f s, %d migrations\n",
+                  n_workers, 1000 * pd.rounds, duration, pd.migrations);
+
+  pool_data_clear ();
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/pool/run", test_run);
+  g_test_add_func ("/pool/pinned", test_pinned);
+  g_test_add_func ("/pool/steal", test_steal);
+  g_test_add_func ("/pool/mutex", test_mutex);
+  if (g_test_perf ())
+    g_test_add_func ("/perf/pool", perf_pool);
+
+  return g_test_run ();
+}
@@ -0,0 +1,261 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <glib-unix.h>
+#include <gcoroutine.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct {
+  gint     fds[2];
+  gint64   end_time;
+  gboolean ready;
+  gboolean done;
+} WaitData;
+
+static void
+socket_pair (gint fds[2])
+{
+  GError *error = NULL;
+  gint i;
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+  for (i = 0; i < 2; i++)
+    {
+      g_unix_set_fd_nonblocking (fds[i], TRUE, &error);
+      g_assert_no_error (error);
+    }
+}
+
+static void
+socket_pair_close (gint fds[2])
+{
+  gint i;
+
+  for (i = 0; i < 2; i++)
+    {
+      g_co_unwatch_fd (fds[i]);
+      close (fds[i]);
+    }
+}
+
+static gpointer
+wait_readable (gpointer data) G_COROUTINE_FUNC
+{
+  WaitData *wd = data;
+
+  wd->ready = g_co_wait_fd (wd->fds[0], G_IO_IN, wd->end_time);
+  wd->done = TRUE;
+
+  return NULL;
+}
+
+static void
+test_wait (void)
+{
+  WaitData wd = { { -1, -1 }, -1, FALSE, FALSE };
+  GCoroutine *co = g_coroutine_new (wait_readable);
+
+  socket_pair (wd.fds);
+  g_coroutine_resume (co, &wd);
+  g_assert (!wd.done);
+
+  g_assert (!g_co_reactor_iteration (FALSE));
+  g_assert (!wd.done);
+
+  g_assert_cmpint (write (wd.fds[1], "x", 1), ==, 1);
+  g_assert (g_co_reactor_iteration (TRUE));
+  g_assert (wd.done);
+  g_assert (wd.ready);
+
+  socket_pair_close (wd.fds);
+}
+
+static void
+test_timeout (void)
+{
+  WaitData wd = { { -1, -1 }, -1, FALSE, FALSE };
+  GCoroutine *co = g_coroutine_new (wait_readable);
+  gint64 start = g_get_monotonic_time ();
+
+  socket_pair (wd.fds);
+  wd.end_time = start + 10 * G_TIME_SPAN_MILLISECOND;
+  g_coroutine_resume (co, &wd);
+
+  while (!wd.done)
+    g_co_reactor_iteration (TRUE);
+
+  g_assert (!wd.ready);
+  g_assert_cmpint (g_get_monotonic_time (), >=, wd.end_time);
+
+  socket_pair_close (wd.fds);
+}
+
+static void
+test_cached (void)
+{
+  WaitData wd = { { -1, -1 }, -1, FALSE, FALSE };
+  GCoroutine *co;
+
+  socket_pair (wd.fds);
+
+  /* register the fd, then leave without waiting */
+  wd.end_time = 0;
+  co = g_coroutine_new (wait_readable);
+  g_coroutine_resume (co, &wd);
+  g_assert (wd.done);
+  g_assert (!wd.ready);
+
+  /* the edge arrives while nobody waits */
+  g_assert_cmpint (write (wd.fds[1], "x", 1), ==, 1);
+  g_assert (!g_co_reactor_iteration (FALSE));
+
+  wd.end_time = -1;
+  wd.done = FALSE;
+  co = g_coroutine_new (wait_readable);
+  g_coroutine_resume (co, &wd);
+  g_assert (wd.done);
+  g_assert (wd.ready);
+
+  socket_pair_close (wd.fds);
+}
+
+/*
+ * Ping-pong benchmark, reactor vs GMainContext
+ */
+
+#define PING_PONG_ROUNDS 100000
+
+typedef gboolean (*WaitFunc) (gint fd);
+
+typedef struct {
+  gint     fd;
+  WaitFunc wait;
+  gboolean initiator;
+  guint    running;
+} PingPongData;
+
+static gboolean
+reactor_wait (gint fd) G_COROUTINE_FUNC
+{
+  return g_co_wait_fd (fd, G_IO_IN, -1);
+}
+
+static gboolean
+fd_ready (gint         fd,
+          GIOCondition condition,
+          gpointer     user_data)
+{
+  g_coroutine_resume (user_data, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+context_wait (gint fd) G_COROUTINE_FUNC
+{
+  g_unix_fd_add (fd, G_IO_IN, fd_ready, g_coroutine_self ());
+  g_coroutine_yield (NULL);
+
+  return TRUE;
+}
+
+static gpointer
+ping_pong (gpointer data) G_COROUTINE_FUNC
+{
+  PingPongData *pp = data;
+  guint i;
+  gchar c = 0;
+
+  for (i = 0; i < PING_PONG_ROUNDS; i++)
+    {
+      if (pp->initiator)
+        g_assert_cmpint (write (pp->fd, &c, 1), ==, 1);
+
+      while (read (pp->fd, &c, 1) != 1)
+        {
+          g_assert_cmpint (errno, ==, EAGAIN);
+          pp->wait (pp->fd);
+        }
+
+      if (!pp->initiator)
+        g_assert_cmpint (write (pp->fd, &c, 1), ==, 1);
+    }
+
+  pp->running--;
+  return NULL;
+}
+
+static gdouble
+ping_pong_run (WaitFunc wait)
+{
+  PingPongData pp[2];
+  gint fds[2], i;
+  gdouble duration;
+
+  socket_pair (fds);
+
+  g_test_timer_start ();
+  for (i = 0; i < 2; i++)
+    {
+      pp[i].fd = fds[i];
+      pp[i].wait = wait;
+      pp[i].initiator = i == 0;
+      pp[i].running = 1;
+      g_coroutine_resume (g_coroutine_new (ping_pong), &pp[i]);
+    }
+
+  while (pp[0].running + pp[1].running > 0)
+    {
+      if (wait == reactor_wait)
+        g_co_reactor_iteration (TRUE);
+      else
+        g_main_context_iteration (NULL, TRUE);
+    }
+  duration = g_test_timer_elapsed ();
+
+  socket_pair_close (fds);
+
+  return duration;
+}
+
+static void
+perf_ping_pong (void)
+{
+  gdouble reactor, context;
+
+  reactor = ping_pong_run (reactor_wait);
+  context = ping_pong_run (context_wait);
+
+  g_test_message ("Ping-pong %u rounds: reactor %f s, main context %f s\n",
+                  PING_PONG_ROUNDS, reactor, context);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/reactor/wait", test_wait);
+  g_test_add_func ("/reactor/timeout", test_timeout);
+  g_test_add_func ("/reactor/cached", test_cached);
+  if (g_test_perf ())
+    g_test_add_func ("/perf/ping-pong", perf_ping_pong);
+
+  return g_test_run ();
+}
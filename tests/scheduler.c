@@ -0,0 +1,335 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <gcoroutine.h>
+#include <string.h>
+
+typedef struct {
+  GString *order;
+  guint    running;
+  guint    rounds;
+} SchedData;
+
+static SchedData sd;
+
+static gpointer
+append_letter (gpointer data) G_COROUTINE_FUNC
+{
+  guint i;
+
+  for (i = 0; i < sd.rounds; i++)
+    {
+      g_string_append (sd.order, data);
+      g_co_yield_to_loop ();
+    }
+  g_string_append (sd.order, data);
+  sd.running--;
+
+  return NULL;
+}
+
+static void
+spawn_letters (GMainContext *context,
+               const gchar  *letters,
+               guint         rounds)
+{
+  sd.order = g_string_new (NULL);
+  sd.rounds = rounds;
+
+  for (; *letters; letters++)
+    {
+      gchar letter[] = { *letters, 0 };
+
+      sd.running++;
+      g_coroutine_spawn (context, append_letter,
+                         (gpointer) g_intern_string (letter));
+    }
+}
+
+static void
+test_spawn (void)
+{
+  spawn_letters (NULL, "abc", 0);
+  g_assert_cmpstr (sd.order->str, ==, "");
+
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (sd.order->str, ==, "abc");
+  g_assert (!g_main_context_pending (NULL));
+  g_string_free (sd.order, TRUE);
+}
+
+static void
+test_yield (void)
+{
+  /* each round waits for the next dispatch */
+  spawn_letters (NULL, "ab", 2);
+
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpstr (sd.order->str, ==, "ab");
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpstr (sd.order->str, ==, "abab");
+
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (sd.order->str, ==, "ababab");
+  g_string_free (sd.order, TRUE);
+}
+
+static void
+test_batch (void)
+{
+  guint i;
+
+  sd.order = g_string_new (NULL);
+  sd.rounds = 0;
+  for (i = 0; i < G_CO_SCHEDULER_BATCH + 10; i++)
+    {
+      sd.running++;
+      g_coroutine_spawn (NULL, append_letter, ".");
+    }
+
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpuint (sd.order->len, ==, G_CO_SCHEDULER_BATCH);
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpuint (sd.order->len, ==, G_CO_SCHEDULER_BATCH + 10);
+  g_assert_cmpuint (sd.running, ==, 0);
+
+  g_string_free (sd.order, TRUE);
+}
+
+static void
+test_context (void)
+{
+  GMainContext *context = g_main_context_new ();
+
+  spawn_letters (context, "ab", 1);
+
+  g_assert (!g_main_context_iteration (NULL, FALSE));
+  g_assert_cmpstr (sd.order->str, ==, "");
+
+  /* g_co_yield_to_loop() goes back to the same context */
+  while (sd.running > 0)
+    g_main_context_iteration (context, TRUE);
+  g_assert_cmpstr (sd.order->str, ==, "abab");
+
+  g_string_free (sd.order, TRUE);
+  g_main_context_unref (context);
+}
+
+static gpointer
+append_priority (gpointer data) G_COROUTINE_FUNC
+{
+  GCoPriority priority = GPOINTER_TO_INT (data);
+  guint i, rounds = priority == G_CO_PRIORITY_HIGH ? 10 : 2;
+
+  /* queued again with its new priority */
+  g_coroutine_set_priority (g_coroutine_self (), priority);
+  g_co_yield_to_loop ();
+
+  for (i = 0; i < rounds; i++)
+    {
+      g_string_append_c (sd.order, "hdl"[priority + 1]);
+      g_co_yield_to_loop ();
+    }
+  sd.running--;
+
+  return NULL;
+}
+
+static void
+test_priority (void)
+{
+  sd.order = g_string_new (NULL);
+  sd.running = 2;
+  g_coroutine_spawn (NULL, append_priority,
+                     GINT_TO_POINTER (G_CO_PRIORITY_LOW));
+  g_coroutine_spawn (NULL, append_priority,
+                     GINT_TO_POINTER (G_CO_PRIORITY_HIGH));
+
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* the low priority coroutine runs once passed over
+   * G_CO_PRIORITY_AGING times, the first time as the other one starts */
+  g_assert_cmpstr (sd.order->str, ==, "hhhhhhhlhhhl");
+  g_string_free (sd.order, TRUE);
+}
+
+static gpointer
+append_rescheduled (gpointer data) G_COROUTINE_FUNC
+{
+  guint i;
+
+  for (i = 0; i < sd.rounds; i++)
+    {
+      g_string_append (sd.order, data);
+      g_co_reschedule ();
+    }
+  sd.running--;
+
+  return NULL;
+}
+
+static void
+test_reschedule (void)
+{
+  sd.order = g_string_new (NULL);
+  sd.rounds = 3;
+  sd.running = 2;
+  g_coroutine_spawn (NULL, append_rescheduled, "a");
+  g_coroutine_spawn (NULL, append_rescheduled, "b");
+
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (sd.order->str, ==, "ababab");
+  g_string_free (sd.order, TRUE);
+}
+
+static gpointer
+compute (gpointer data) G_COROUTINE_FUNC
+{
+  gint64 end_time = g_get_monotonic_time () + 50000;
+  GCoBudget budget;
+
+  /* 5 ms slices of busy work */
+  g_co_budget_init (&budget, 5000);
+  while (g_get_monotonic_time () < end_time)
+    if (g_co_budget_tick (&budget))
+      g_string_append_c (sd.order, 'c');
+  sd.running--;
+
+  return NULL;
+}
+
+static gpointer
+interleave (gpointer data) G_COROUTINE_FUNC
+{
+  while (sd.running > 1)
+    {
+      g_string_append_c (sd.order, 'i');
+      g_co_reschedule ();
+    }
+  sd.running--;
+
+  return NULL;
+}
+
+static void
+test_budget (void)
+{
+  sd.order = g_string_new (NULL);
+  sd.running = 2;
+  g_coroutine_spawn (NULL, compute, NULL);
+  g_coroutine_spawn (NULL, interleave, NULL);
+
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* the other coroutine ran between the time slices */
+  g_assert_cmpuint (sd.order->len, >=, 10);
+  g_assert (strstr (sd.order->str, "cicici") != NULL);
+  g_string_free (sd.order, TRUE);
+}
+
+/*
+ * Yield to loop benchmark
+ */
+
+static void
+perf_yield_to_loop (void)
+{
+  gdouble duration;
+
+  sd.order = g_string_new (NULL);
+  sd.rounds = 1000000;
+  sd.running = 1;
+  g_coroutine_spawn (NULL, append_letter, "");
+
+  g_test_timer_start ();
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+  duration = g_test_timer_elapsed ();
+
+  g_test_message ("Yield to loop %u iterations: %f s\n",
+                  sd.rounds, duration);
+
+  g_string_free (sd.order, TRUE);
+}
+
+/*
+ * Budget tick benchmark
+ */
+
+#define PERF_TICKS 100000000
+
+static gpointer
+count_ticks (gpointer data) G_COROUTINE_FUNC
+{
+  GCoBudget budget;
+  guint i;
+
+  g_co_budget_init (&budget, 10000);
+  for (i = 0; i < PERF_TICKS; i++)
+    if (g_co_budget_tick (&budget))
+      sd.rounds++;
+  sd.running--;
+
+  return NULL;
+}
+
+static void
+perf_budget (void)
+{
+  gdouble duration;
+
+  sd.rounds = 0;
+  sd.running = 1;
+  g_coroutine_spawn (NULL, count_ticks, NULL);
+
+  g_test_timer_start ();
+  while (sd.running > 0)
+    g_main_context_iteration (NULL, TRUE);
+  duration = g_test_timer_elapsed ();
+
+  g_test_message ("Budget %u ticks: %f s, %u reschedules\n",
+                  PERF_TICKS, duration, sd.rounds);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/scheduler/spawn", test_spawn);
+  g_test_add_func ("/scheduler/yield", test_yield);
+  g_test_add_func ("/scheduler/batch", test_batch);
+  g_test_add_func ("/scheduler/context", test_context);
+  g_test_add_func ("/scheduler/priority", test_priority);
+  g_test_add_func ("/scheduler/reschedule", test_reschedule);
+  g_test_add_func ("/scheduler/budget", test_budget);
+  if (g_test_perf ())
+    {
+      g_test_add_func ("/perf/yield-to-loop", perf_yield_to_loop);
+      g_test_add_func ("/perf/budget", perf_budget);
+    }
+
+  return g_test_run ();
+}
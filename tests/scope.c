@@ -0,0 +1,155 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <gcoroutine.h>
+
+#define N_CHILDREN 8
+
+#define TEST_ERROR (g_quark_from_static_string ("test-error"))
+
+typedef struct {
+  guint    fail;                /* the child failing, if any */
+  gint64   usec;                /* the sleep of the others but the first */
+  guint    started;
+  guint    slept;
+  guint    cancelled;
+  gboolean joined;
+  GError  *error;
+} ScopeData;
+
+static ScopeData sd;
+
+static gpointer
+child (gpointer data) G_COROUTINE_FUNC
+{
+  guint i = GPOINTER_TO_UINT (data);
+
+  sd.started++;
+  if (i == sd.fail)
+    {
+      g_co_sleep (10000);
+      g_co_scope_return_error (g_error_new_literal (TEST_ERROR, i, "failed"));
+      return NULL;
+    }
+
+  if (g_co_sleep (i == 0 ? 20000 : sd.usec))
+    sd.slept++;
+  if (g_coroutine_is_cancelled (g_coroutine_self ()))
+    sd.cancelled++;
+
+  return NULL;
+}
+
+static gpointer
+parent (gpointer data) G_COROUTINE_FUNC
+{
+  GCoScope *scope = g_co_scope_new ();
+  guint i;
+
+  for (i = 0; i < N_CHILDREN; i++)
+    g_co_scope_spawn (scope, child, GUINT_TO_POINTER (i));
+
+  /* started together, once the parent yields */
+  g_assert_cmpuint (sd.started, ==, 0);
+  sd.joined = g_co_scope_join (scope, &sd.error);
+  g_assert_cmpuint (sd.started, ==, N_CHILDREN);
+
+  return NULL;
+}
+
+static GCoroutine *
+run_parent (guint  fail,
+            gint64 usec)
+{
+  GCoroutine *co = g_coroutine_new (parent);
+  ScopeData init = { fail, usec, 0, 0, 0, FALSE, NULL };
+
+  sd = init;
+  g_coroutine_ref (co);
+  g_coroutine_resume (co, NULL);
+
+  return co;
+}
+
+static void
+test_join (void)
+{
+  GCoroutine *co = run_parent (N_CHILDREN, 30000);
+
+  while (g_coroutine_resumable (co))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert (sd.joined);
+  g_assert_no_error (sd.error);
+  g_assert_cmpuint (sd.slept, ==, N_CHILDREN);
+  g_assert_cmpuint (sd.cancelled, ==, 0);
+
+  g_coroutine_unref (co);
+}
+
+static void
+test_cancel (void)
+{
+  /* long enough for the test to time out, unless cancelled */
+  GCoroutine *co = run_parent (N_CHILDREN, 100 * G_USEC_PER_SEC);
+  guint i;
+
+  /* only the first child is short-lived: cancel the others */
+  for (i = 0; i < 5 && sd.slept == 0; i++)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpuint (sd.slept, ==, 1);
+  g_assert (g_coroutine_resumable (co));
+
+  g_coroutine_cancel (co);
+  g_assert (!g_coroutine_resumable (co));
+  g_assert (!sd.joined);
+  g_assert_error (sd.error, G_CO_SCOPE_ERROR, G_CO_SCOPE_ERROR_CANCELLED);
+  g_assert_cmpuint (sd.cancelled, ==, N_CHILDREN - 1);
+
+  g_clear_error (&sd.error);
+  g_coroutine_unref (co);
+}
+
+static void
+test_error (void)
+{
+  GCoroutine *co = run_parent (3, 100 * G_USEC_PER_SEC);
+
+  while (g_coroutine_resumable (co))
+    g_main_context_iteration (NULL, TRUE);
+
+  /* the first error wins, and the others were cancelled */
+  g_assert (!sd.joined);
+  g_assert_error (sd.error, TEST_ERROR, 3);
+  g_assert_cmpuint (sd.slept, ==, 0);
+  g_assert_cmpuint (sd.cancelled, ==, N_CHILDREN - 1);
+
+  g_clear_error (&sd.error);
+  g_coroutine_unref (co);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/scope/join", test_join);
+  g_test_add_func ("/scope/cancel", test_cancel);
+  g_test_add_func ("/scope/error", test_error);
+
+  return g_test_run ();
+}
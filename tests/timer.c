@@ -0,0 +1,220 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <gcoroutine.h>
+#include <string.h>
+
+typedef struct {
+  gint64   usec;
+  gint64   woken;
+  gboolean slept;
+  GString *order;
+  gchar    name;
+} SleepData;
+
+static gpointer
+sleep_for (gpointer data) G_COROUTINE_FUNC
+{
+  SleepData *sd = data;
+  gint64 start = g_get_monotonic_time ();
+
+  sd->slept = g_co_sleep (sd->usec);
+  sd->woken = g_get_monotonic_time () - start;
+  if (sd->order)
+    g_string_append_c (sd->order, sd->name);
+
+  return NULL;
+}
+
+static void
+test_sleep (void)
+{
+  SleepData sd = { 20000, -1, FALSE, NULL, 0 };
+  GCoroutine *co = g_coroutine_new (sleep_for);
+
+  g_coroutine_resume (co, &sd);
+  g_assert_cmpint (sd.woken, ==, -1);
+
+  while (sd.woken == -1)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert (sd.slept);
+  g_assert_cmpint (sd.woken, >=, sd.usec);
+}
+
+static void
+test_order (void)
+{
+  /* across the first two levels of the wheel */
+  static const gint64 delays[] = { 90, 10, 250, 70, 30, 65, 0 };
+  SleepData sd[G_N_ELEMENTS (delays)];
+  GString *order = g_string_new (NULL);
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (delays); i++)
+    {
+      SleepData init = { delays[i] * 1000, -1, FALSE, order, 'a' + i };
+
+      sd[i] = init;
+      g_coroutine_resume (g_coroutine_new (sleep_for), &sd[i]);
+    }
+
+  while (order->len < G_N_ELEMENTS (delays))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (order->str, ==, "gbefdac");
+  for (i = 0; i < G_N_ELEMENTS (delays); i++)
+    {
+      g_assert (sd[i].slept);
+      g_assert_cmpint (sd[i].woken, >=, sd[i].usec);
+    }
+
+  g_string_free (order, TRUE);
+}
+
+static gboolean
+quit_loop (gpointer data)
+{
+  g_main_loop_quit (data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_early (void)
+{
+  SleepData sd = { 30000, -1, FALSE, NULL, 0 };
+  GCoroutine *co = g_coroutine_new (sleep_for);
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  g_coroutine_ref (co);
+  g_coroutine_resume (co, &sd);
+
+  /* resumed before the deadline, the timer goes away */
+  g_coroutine_resume (co, NULL);
+  g_assert (!sd.slept);
+  g_assert_cmpint (sd.woken, <, sd.usec);
+  g_assert (!g_coroutine_resumable (co));
+  g_coroutine_unref (co);
+
+  g_timeout_add (50, quit_loop, loop);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+}
+
+static void
+test_cancel (void)
+{
+  SleepData sd = { G_USEC_PER_SEC, -1, FALSE, NULL, 0 };
+  GCoroutine *co = g_coroutine_new (sleep_for);
+
+  g_coroutine_resume (co, &sd);
+  g_coroutine_cancel (co);
+  g_assert (!sd.slept);
+  g_assert_cmpint (sd.woken, <, sd.usec);
+
+  /* a cancelled coroutine does not sleep anymore */
+  co = g_coroutine_new (sleep_for);
+  g_coroutine_cancel (co);
+  g_coroutine_resume (co, &sd);
+  g_assert (!sd.slept);
+  g_assert_cmpint (sd.woken, <, sd.usec);
+}
+
+/*
+ * Sleep benchmark, against one timeout source per coroutine
+ */
+
+#define PERF_SLEEPERS 10000
+
+static guint perf_done;
+
+static gpointer
+perf_sleep (gpointer data) G_COROUTINE_FUNC
+{
+  g_co_sleep (GPOINTER_TO_UINT (data));
+  perf_done++;
+
+  return NULL;
+}
+
+static gboolean
+resume_sleeper (gpointer data)
+{
+  g_coroutine_resume (data, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+perf_timeout (gpointer data) G_COROUTINE_FUNC
+{
+  g_timeout_add (GPOINTER_TO_UINT (data) / 1000, resume_sleeper,
+                 g_coroutine_self ());
+  g_coroutine_yield (NULL);
+  perf_done++;
+
+  return NULL;
+}
+
+static gdouble
+perf_run (GCoroutineFunc func)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  guint i;
+
+  perf_done = 0;
+  g_test_timer_start ();
+
+  for (i = 0; i < PERF_SLEEPERS; i++)
+    g_coroutine_resume (g_coroutine_new (func),
+                        GUINT_TO_POINTER (g_rand_int_range (rand, 1, 500) * 1000));
+
+  while (perf_done < PERF_SLEEPERS)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_rand_free (rand);
+
+  return g_test_timer_elapsed ();
+}
+
+static void
+perf_timers (void)
+{
+  gdouble wheel, sources;
+
+  wheel = perf_run (perf_sleep);
+  sources = perf_run (perf_timeout);
+
+  g_test_message ("%d sleepers over 500 ms: wheel %f s, timeout sources %f s\n",
+                  PERF_SLEEPERS, wheel, sources);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/timer/sleep", test_sleep);
+  g_test_add_func ("/timer/order", test_order);
+  g_test_add_func ("/timer/early", test_early);
+  g_test_add_func ("/timer/cancel", test_cancel);
+  if (g_test_perf ())
+    g_test_add_func ("/perf/timers", perf_timers);
+
+  return g_test_run ();
+}
@@ -0,0 +1,293 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the licence, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gcoroutine.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct {
+  gint     fd;
+  gint64   offset;
+  gchar    buf[8];
+  gssize   res;
+  gint     errsv;
+  gboolean done;
+} IOData;
+
+static gpointer
+write_fsync_read (gpointer data) G_COROUTINE_FUNC
+{
+  IOData *io = data;
+
+  g_assert_cmpint (g_co_write (io->fd, "coroutine", 9, 0), ==, 9);
+  g_assert_cmpint (g_co_fsync (io->fd), ==, 0);
+  io->res = g_co_read (io->fd, io->buf, 4, 2);
+  io->done = TRUE;
+
+  return NULL;
+}
+
+static void
+test_file (void)
+{
+  IOData io = { -1, 0, "", 0, 0, FALSE };
+  GError *error = NULL;
+  GCoroutine *co;
+  gchar *path;
+
+  io.fd = g_file_open_tmp ("gcoroutine-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+
+  co = g_coroutine_new (write_fsync_read);
+  g_coroutine_resume (co, &io);
+  while (!io.done)
+    g_co_uring_iteration (TRUE);
+
+  g_assert_cmpint (io.res, ==, 4);
+  g_assert (memcmp (io.buf, "rout", 4) == 0);
+
+  g_coroutine_unref (co);
+
+  close (io.fd);
+  g_unlink (path);
+  g_free (path);
+}
+
+static gpointer
+read_byte (gpointer data) G_COROUTINE_FUNC
+{
+  IOData *io = data;
+
+  io->res = g_co_read (io->fd, io->buf, 1, io->offset);
+  io->errsv = errno;
+  io->done = TRUE;
+
+  return NULL;
+}
+
+static void
+test_batch (void)
+{
+  IOData io[4];
+  GCoroutine *co[G_N_ELEMENTS (io)];
+  gint fds[2], i;
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+  /* the four reads are submitted at once by the iteration */
+  for (i = 0; i < G_N_ELEMENTS (io); i++)
+    {
+      memset (&io[i], 0, sizeof (io[i]));
+      io[i].fd = fds[0];
+      io[i].offset = -1;
+      co[i] = g_coroutine_new (read_byte);
+      g_coroutine_resume (co[i], &io[i]);
+    }
+  g_assert_cmpint (write (fds[1], "abcd", 4), ==, 4);
+
+  while (!g_co_uring_iteration (FALSE))
+    ;
+
+  for (i = 0; i < G_N_ELEMENTS (io); i++)
+    while (!io[i].done)
+      g_co_uring_iteration (TRUE);
+
+  for (i = 0; i < G_N_ELEMENTS (io); i++)
+    {
+      g_assert_cmpint (io[i].res, ==, 1);
+      g_coroutine_unref (co[i]);
+    }
+
+  close (fds[0]);
+  close (fds[1]);
+}
+
+static void
+test_full (void)
+{
+  /* more reads in a tick than the submission ring can hold */
+  IOData io[600];
+  GCoroutine *co[G_N_ELEMENTS (io)];
+  gint fd, i;
+
+  fd = open ("/dev/zero", O_RDONLY | O_CLOEXEC);
+  g_assert_cmpint (fd, >=, 0);
+
+  for (i = 0; i < G_N_ELEMENTS (io); i++)
+    {
+      memset (&io[i], 0, sizeof (io[i]));
+      io[i].fd = fd;
+      io[i].offset = -1;
+      co[i] = g_coroutine_new (read_byte);
+      g_coroutine_resume (co[i], &io[i]);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (io); i++)
+    while (!io[i].done)
+      g_co_uring_iteration (TRUE);
+
+  for (i = 0; i < G_N_ELEMENTS (io); i++)
+    {
+      g_assert_cmpint (io[i].res, ==, 1);
+      g_coroutine_unref (co[i]);
+    }
+
+  close (fd);
+}
+
+static void
+test_error (void)
+{
+  IOData io = { -1, -1, "", 0, 0, FALSE };
+  GCoroutine *co = g_coroutine_new (read_byte);
+
+  g_coroutine_resume (co, &io);
+  while (!io.done)
+    g_co_uring_iteration (TRUE);
+
+  g_assert_cmpint (io.res, ==, -1);
+  g_assert_cmpint (io.errsv, ==, EBADF);
+
+  g_coroutine_unref (co);
+}
+
+static void
+test_unavailable (void)
+{
+  IOData io = { -1, -1, "", 0, 0, FALSE };
+
+  if (g_test_subprocess ())
+    {
+      /* fail io_uring_setup() as when io_uring is disabled */
+      struct sock_filter filter[] = {
+        BPF_STMT (BPF_LD | BPF_W | BPF_ABS, offsetof (struct seccomp_data, nr)),
+        BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 0, 1),
+        BPF_STMT (BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS),
+        BPF_STMT (BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+      };
+      struct sock_fprog prog = { G_N_ELEMENTS (filter), filter };
+      GCoroutine *co;
+
+      g_assert_cmpint (prctl (PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0), ==, 0);
+      g_assert_cmpint (prctl (PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog), ==, 0);
+
+      co = g_coroutine_new (read_byte);
+      g_coroutine_resume (co, &io);
+      g_assert (io.done);
+      g_assert_cmpint (io.res, ==, -1);
+      g_assert_cmpint (io.errsv, ==, ENOSYS);
+      g_assert (!g_co_uring_iteration (TRUE));
+      g_coroutine_unref (co);
+      return;
+    }
+
+  g_test_trap_subprocess (NULL, 0, 0);
+  g_test_trap_assert_passed ();
+}
+
+typedef struct {
+  gint               listener;
+  struct sockaddr_in addr;
+  guint              running;
+} SocketData;
+
+static gpointer
+serve (gpointer data) G_COROUTINE_FUNC
+{
+  SocketData *sd = data;
+  gchar buf[4];
+  gint fd;
+
+  fd = g_co_accept (sd->listener, NULL, NULL);
+  g_assert_cmpint (fd, >=, 0);
+  g_assert_cmpint (g_co_read (fd, buf, sizeof (buf), -1), ==, 4);
+  g_assert_cmpint (g_co_write (fd, buf, sizeof (buf), -1), ==, 4);
+  close (fd);
+
+  sd->running--;
+  return NULL;
+}
+
+static gpointer
+client (gpointer data) G_COROUTINE_FUNC
+{
+  SocketData *sd = data;
+  gchar buf[4];
+  gint fd;
+
+  fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  g_assert_cmpint (g_co_connect (fd, &sd->addr, sizeof (sd->addr)), ==, 0);
+  g_assert_cmpint (g_co_write (fd, "ping", 4, -1), ==, 4);
+  g_assert_cmpint (g_co_read (fd, buf, sizeof (buf), -1), ==, 4);
+  g_assert (memcmp (buf, "ping", 4) == 0);
+  close (fd);
+
+  sd->running--;
+  return NULL;
+}
+
+static void
+test_socket (void)
+{
+  SocketData sd;
+  GCoroutine *server_co, *client_co;
+  socklen_t len = sizeof (sd.addr);
+
+  memset (&sd, 0, sizeof (sd));
+  sd.addr.sin_family = AF_INET;
+  sd.addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  sd.listener = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  g_assert_cmpint (bind (sd.listener, (struct sockaddr *)&sd.addr, len), ==, 0);
+  g_assert_cmpint (listen (sd.listener, 1), ==, 0);
+  g_assert_cmpint (getsockname (sd.listener, (struct sockaddr *)&sd.addr, &len), ==, 0);
+
+  sd.running = 2;
+  server_co = g_coroutine_new (serve);
+  g_coroutine_resume (server_co, &sd);
+  client_co = g_coroutine_new (client);
+  g_coroutine_resume (client_co, &sd);
+  while (sd.running > 0)
+    g_co_uring_iteration (TRUE);
+
+  g_coroutine_unref (client_co);
+  g_coroutine_unref (server_co);
+  close (sd.listener);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/uring/file", test_file);
+  g_test_add_func ("/uring/batch", test_batch);
+  g_test_add_func ("/uring/full", test_full);
+  g_test_add_func ("/uring/error", test_error);
+  g_test_add_func ("/uring/unavailable", test_unavailable);
+  g_test_add_func ("/uring/socket", test_socket);
+
+  return g_test_run ();
+}